@@ -0,0 +1,116 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include "configk.h"
+
+/*
+ * Block conditions: an 'if <expr>' or a 'menu' with 'depends on' lines is
+ * one shared condition, linked from every option inside the block along
+ * with the enclosing blocks. Its value is kept until an option value
+ * changes, see journal_record().
+ */
+
+extern int8_t eescans(uint8_t, const char *, char **);
+
+bCond *
+block_push(char *expr)
+{
+    bCond *b = calloc(1, sizeof(bCond));
+    if (!b)
+        failx("could not allocate block condition");
+
+    b->expr = expr;
+    b->up = ck->cblock;
+    b->gen = ck->vgen - 1;
+    b->next = ck->blocks;
+    ck->blocks = b;
+
+    return ck->cblock = b;
+}
+
+void
+block_pop(void)
+{
+    if (ck->cblock)
+        ck->cblock = ck->cblock->up;
+
+    return;
+}
+
+bCond *
+block_curr(void)
+{
+    return ck->cblock;
+}
+
+void
+block_depends(bCond *b, char *expr)
+{
+    b->expr = append(b->expr, expr);
+    b->gen = ck->vgen - 1;
+
+    return;
+}
+
+/* value of a block and its enclosing ones, -1 if none has a condition */
+int8_t
+block_eval(bCond *b)
+{
+    if (!b)
+        return -1;
+    if (b->gen == ck->vgen)
+        return b->value;
+
+    int8_t u = block_eval(b->up);
+    int8_t r = (b->expr && u) ? eescans(EXPR_DEPENDS, b->expr, NULL) : -1;
+
+    if (!u || r < 0 || (u > 0 && u < r))
+        r = u;
+    b->value = r;
+    b->gen = ck->vgen;
+
+    return r;
+}
+
+/* innermost condition of a block which is not met, or NULL */
+const char *
+block_failed(const bCond *b)
+{
+    for (; b; b = b->up)
+        if (b->expr && !eescans(EXPR_DEPENDS, b->expr, NULL))
+            return b->expr;
+
+    return NULL;
+}
+
+uint32_t
+block_free(void)
+{
+    uint32_t tmem = 0;
+
+    while (ck->blocks)
+    {
+        bCond *b = ck->blocks;
+        ck->blocks = b->next;
+        tmem += sizeof(*b) + (b->expr ? strlen(b->expr) : 0);
+        free(b->expr);
+        free(b);
+    }
+    ck->cblock = NULL;
+
+    return tmem;
+}
@@ -0,0 +1,214 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include "configk.h"
+
+/*
+ * Choice groups: each choice keeps a table of its member options and the
+ * enabled one. The active member is trusted while it stays enabled; values
+ * changed outside of toggle_configs(), ie. while reading a '.config' file or
+ * by a journal rollback, clear it and the next use finds it by a scan.
+ */
+
+extern int8_t eescans(uint8_t, const char *, char **);
+
+static void
+choice_group(cNode *ch)
+{
+    chGroup *g = calloc(1, sizeof(chGroup));
+    if (!g)
+        failx("could not allocate choice group");
+
+    g->choice = ch;
+    for (cNode *c = ch->down; c; c = c->next)
+        g->nmember += (c->type == CENTRY);
+    g->member = calloc(g->nmember + 1, sizeof(cNode *));
+    if (!g->member)
+        failx("could not allocate choice group");
+
+    g->nmember = 0;
+    for (cNode *c = ch->down; c; c = c->next)
+    {
+        if (c->type != CENTRY)
+            continue;
+        g->member[g->nmember++] = c;
+        ((cEntry *)c->data)->opt_group = g;
+    }
+    ((cEntry *)ch->data)->opt_group = g;
+
+    return;
+}
+
+void
+choice_build(cNode *c)
+{
+    for (; c; c = c->next)
+    {
+        if (c->type == CHENTRY && !((cEntry *)c->data)->opt_group)
+            choice_group(c);
+        choice_build(c->down);
+    }
+
+    return;
+}
+
+cNode *
+choice_active(chGroup *g)
+{
+    if (g->active && ((cEntry *)g->active->data)->opt_status > 0)
+        return g->active;
+
+    g->active = NULL;
+    for (uint16_t i = 0; i < g->nmember && !g->active; i++)
+        if (((cEntry *)g->member[i]->data)->opt_status > 0)
+            g->active = g->member[i];
+
+    return g->active;
+}
+
+void
+choice_invalidate(const cEntry *t)
+{
+    if (t->opt_group)
+        t->opt_group->active = NULL;
+
+    return;
+}
+
+static bool
+choice_visible(const cNode *c)
+{
+    return 0 != check_depends(((cEntry *)c->data)->opt_name);
+}
+
+/*
+ * Member named by the first 'default' clause of a choice whose condition
+ * holds, or else its first visible member; 'skip' is never returned.
+ */
+cNode *
+choice_default(const chGroup *g, const cNode *skip)
+{
+    cNode *d = NULL;
+    const char *v = ((cEntry *)g->choice->data)->opt_value;
+    char *p, *dv = v ? strdup(v) : NULL;
+
+    for (char *s = dv ? strtok_r(dv, ";", &p) : NULL; s && !d;
+                                                s = strtok_r(NULL, ";", &p))
+    {
+        char *cond = strstr(s, " if ");
+        if (cond)
+        {
+            *cond = '\0';
+            cond += 4;
+        }
+        s += strspn(s, " \n\t");
+        s[strcspn(s, " \n\t")] = '\0';
+
+        cNode *c = hsearch_kconfigs(s);
+        if (!c || c == skip || ((cEntry *)c->data)->opt_group != g
+            || !choice_visible(c))
+            continue;
+        if (!cond || eescans(EXPR_DEPENDS, cond, NULL) > 0)
+            d = c;
+    }
+    free(dv);
+
+    for (uint16_t i = 0; i < g->nmember && !d; i++)
+        if (g->member[i] != skip && choice_visible(g->member[i]))
+            d = g->member[i];
+
+    return d;
+}
+
+/* 'c' was enabled: disable the previously active member */
+void
+choice_select(cNode *c)
+{
+    chGroup *g = ((cEntry *)c->data)->opt_group;
+    cNode *a = g->active;
+
+    if (a && ((cEntry *)a->data)->opt_status <= 0)
+        a = NULL;
+    g->active = c;
+    if (a == c)
+        return;
+
+    if (a)
+    {
+        toggle_trace("Disable option:");
+        toggle_configs(((cEntry *)a->data)->opt_name,
+                                    DISABLE_CONFIG, NULL, true);
+        return;
+    }
+
+    /* active member not known: disable all others */
+    for (uint16_t i = 0, n = 0; i < g->nmember; i++)
+    {
+        cEntry *m = g->member[i]->data;
+        if (m->opt_status <= 0 || g->member[i] == c)
+            continue;
+        if (!n++)
+            toggle_trace("Disable option:");
+        toggle_configs(m->opt_name, DISABLE_CONFIG, NULL, true);
+    }
+
+    return;
+}
+
+/* 'c' was disabled: fall back to the choice default if none is enabled */
+void
+choice_release(cNode *c)
+{
+    cEntry *t = c->data;
+    chGroup *g = t->opt_group;
+
+    /* while 'c' was the active member no other one is enabled */
+    if (g->active != c && choice_active(g))
+        return;
+
+    g->active = NULL;
+    cNode *d = choice_default(g, c);
+    if (!d)
+    {
+        diagx(DIAG_CHOICE, t->opt_name,
+                "last choice '%s' disabled, none enabled now", t->opt_name);
+        return;
+    }
+
+    char *y = strdup("y");
+    g->active = d;
+    toggle_trace("Enable choice default:");
+    toggle_configs(((cEntry *)d->data)->opt_name, ENABLE_CONFIG, y, true);
+    free(y);
+
+    return;
+}
+
+uint32_t
+choice_free(chGroup *g)
+{
+    uint32_t tmem = 0;
+
+    if (!g)
+        return tmem;
+
+    tmem = sizeof(*g) + (g->nmember + 1) * sizeof(cNode *);
+    free(g->member);
+    free(g);
+
+    return tmem;
+}
@@ -0,0 +1,370 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "configk.h"
+
+/*
+ * '.config' reader: the file is mapped and split into lines with memchr(3).
+ * 'CONFIG_X=val' and '# CONFIG_X is not set' lines are parsed in place, all
+ * other lines are passed through as one block in the SHOW_CONFIG mode, to
+ * the stream of ck_write_config().
+ * A file named '-' is the standard input: it is read once into memory and
+ * the same copy is read again by later calls, as --filter does.
+ *
+ * Files read one after the other are merged: a later value of an option
+ * wins. The file and line which set each value are kept, so that a value
+ * changed by a later line is reported with both places.
+ */
+
+/* cache recently edited entries */
+#define REDITSZ 256
+
+struct c_read
+{
+    uint16_t reindex;
+    cEntry *redits[REDITSZ];
+
+    /* standard input, read by the first check_kconfigs("-") */
+    char *cin;
+    size_t ncin;
+    bool cinread;
+
+    /* files read, the current one and its line */
+    char **cnames;
+    uint16_t ncnames;
+    const char *cname;
+    uint32_t cline;
+}; /* kept in the handle, the names outlive the files read */
+
+#define reindex (ck->cread->reindex)
+#define redits (ck->cread->redits)
+#define cin (ck->cread->cin)
+#define ncin (ck->cread->ncin)
+#define cinread (ck->cread->cinread)
+#define cnames (ck->cread->cnames)
+#define ncnames (ck->cread->ncnames)
+#define cname (ck->cread->cname)
+#define cline (ck->cread->cline)
+
+static void
+config_state(void)
+{
+    if (!ck->cread && !(ck->cread = calloc(1, sizeof(cRead))))
+        failx("could not allocate config state");
+    return;
+}
+
+static uint8_t
+is_redits(cEntry *t)
+{
+    for (int i = 0; i < reindex; i++)
+        if (redits[i] == t)
+            return 1;
+
+    return 0;
+}
+
+uint8_t
+cache_redits(cEntry *t)
+{
+    config_state();
+    if (is_redits(t))
+        return 0;
+
+    /* full: the oldest ones are dropped */
+    redits[reindex++] = t;
+    reindex %= REDITSZ;
+
+    return reindex;
+}
+
+/* keep the line which sets an option, report one it overrides */
+static void
+config_source(cEntry *t, const char *val, uint8_t cstatus)
+{
+    const char *old = -CVALNOSET == t->opt_status ? "n" : t->opt_value;
+    const char *new = DISABLE_CONFIG == cstatus ? "n" : val;
+
+    if (t->opt_cfile && old && strcmp(old, new))
+        diagx(DIAG_OVERRIDE, t->opt_name,
+                "%s:%u: CONFIG_%s=%s overrides %s:%u: CONFIG_%s=%s",
+                cname, cline, t->opt_name, new,
+                t->opt_cfile, t->opt_cline, t->opt_name, old);
+
+    t->opt_cfile = cname;
+    t->opt_cline = cline;
+    return;
+}
+
+static void
+config_entry(char *name, char *val, uint8_t cstatus)
+{
+    cNode *c = hsearch_kconfigs(name);
+    cEntry *t = c ? (cEntry *)c->data : NULL;
+    uint8_t ceditflag = 0;
+    char head[256];
+
+    /* the line telling an edit is traced with the option, see toggle_trace() */
+    if (EDIT_CONFIG == postedit)
+    {
+        if (!t || is_redits(t))
+            return;
+        else if (cstatus == ENABLE_CONFIG)
+        {
+            if (t->opt_status == -CVALNOSET)
+            {
+                ceditflag = 1;
+                toggle_trace("Enable option:");
+            }
+            else if (strcmp(t->opt_value, val))
+            {
+                ceditflag = 1;
+                snprintf(head, sizeof(head), "Edit option %s: %s => %s",
+                                                    name, t->opt_value, val);
+                toggle_trace(head);
+            }
+        }
+        else if (cstatus == DISABLE_CONFIG && t->opt_status != -CVALNOSET)
+        {
+            ceditflag = 1;
+            toggle_trace("Disable option:");
+        }
+    }
+    if (!postedit && t)
+        config_source(t, val, cstatus);
+    if (!postedit || ceditflag)
+        toggle_configs(name, cstatus, val, postedit);
+
+    if (SHOW_CONFIG == postedit)
+    {
+        if (t)
+        {
+            if (t->opt_status == -CVALNOSET)
+                fprintf(ck->cout, "# CONFIG_%s is not set\n", t->opt_name);
+            else
+                fprintf(ck->cout, "CONFIG_%s=%s\n",
+                                                t->opt_name, t->opt_value);
+        }
+        else
+        {
+            diagx(DIAG_MISSING, name,
+                    "option '%s' not found in the source tree", name);
+            if (cstatus == ENABLE_CONFIG)
+                fprintf(ck->cout, "CONFIG_%s=%s\n", name, val);
+            else if (cstatus == DISABLE_CONFIG)
+                fprintf(ck->cout, "# CONFIG_%s is not set\n", name);
+        }
+    }
+
+    return;
+}
+
+/*
+ * Parse a config line of 'n' bytes, without its new line. Returns its
+ * status, or 0 if it is not a config line. Name and value are copied to
+ * 'buf' one after the other, NUL terminated.
+ */
+static uint8_t
+config_line(const char *l, size_t n, char *buf)
+{
+    uint8_t cstatus = ENABLE_CONFIG;
+    const char *e = l + n;
+
+    if ('#' == *l)
+    {
+        cstatus = DISABLE_CONFIG;
+        for (l++; l < e && (' ' == *l || '\t' == *l); l++);
+    }
+    if (e - l < 8 || memcmp(l, "CONFIG_", 7))
+        return 0;
+
+    const char *s = l += 7;
+    while (l < e && ('_' == *l || (*l >= '0' && *l <= '9')
+            || (*l >= 'A' && *l <= 'Z') || (*l >= 'a' && *l <= 'z')))
+        l++;
+    if (l == s)
+        return 0;
+
+    char *name = buf, *val = buf + (l - s) + 1;
+    if (l < e && '=' == *l && e - l > 1)
+        memcpy(val, l + 1, e - l - 1);
+    else if (e - l == 11 && !memcmp(l, " is not set", 11))
+        memcpy(val, l + 1, e - l - 1);
+    else
+        return 0;
+
+    memcpy(name, s, l - s);
+    name[l - s] = '\0';
+    val[e - l - 1] = '\0';
+
+    return cstatus;
+}
+
+static void
+config_scan(const char *m, size_t len)
+{
+    size_t bsz = 4096;
+    char *buf = malloc(bsz);
+    const char *p = m, *end = m + len, *pass = m;
+
+    cline = 0;
+    while (buf && p < end)
+    {
+        const char *nl = memchr(p, '\n', end - p);
+        size_t n = (nl ? nl : end) - p;
+
+        cline++;
+        if (('C' == *p || '#' == *p) && n + 2 > bsz)
+            buf = realloc(buf, bsz = n + 2);
+        uint8_t cstatus = 0;
+        if (buf && ('C' == *p || '#' == *p))
+            cstatus = config_line(p, n, buf);
+        if (cstatus)
+        {
+            /* write other lines seen since the last config line */
+            if (SHOW_CONFIG == postedit && pass < p)
+                fwrite(pass, 1, p - pass, ck->cout);
+            config_entry(buf, buf + strlen(buf) + 1, cstatus);
+            pass = nl ? nl + 1 : end;
+        }
+        p = nl ? nl + 1 : end;
+    }
+    if (SHOW_CONFIG == postedit && pass < end)
+        fwrite(pass, 1, end - pass, ck->cout);
+    if (!buf)
+        failx("could not allocate config line buffer");
+
+    free(buf);
+    return;
+}
+
+static int
+config_stdin(void)
+{
+    size_t sz = ncin;
+    ssize_t n = 1;
+
+    reindex = 0;
+    while (!cinread && n > 0)
+    {
+        if (ncin == sz)
+        {
+            sz = sz ? sz * 2 : 65536;
+            if (!(cin = realloc(cin, sz)))
+                failx("could not allocate config buffer");
+        }
+        if ((n = read(STDIN_FILENO, cin + ncin, sz - ncin)) > 0)
+            ncin += n;
+        else if (n < 0 && EINTR == errno)
+            n = 1;
+        else if (n < 0)
+        {
+            diagx(DIAG_ERROR, NULL,
+                    "could not read standard input: %s", strerror(errno));
+            return -1;
+        }
+    }
+    cinread = true;
+
+    config_scan(cin, ncin);
+    return 0;
+}
+
+uint32_t
+config_free(void)
+{
+    uint32_t tmem = 0;
+
+    if (!ck->cread)
+        return tmem;
+
+    tmem = ncin;
+    free(cin);
+
+    for (uint16_t i = 0; i < ncnames; i++)
+    {
+        tmem += strlen(cnames[i]);
+        free(cnames[i]);
+    }
+    free(cnames);
+    free(ck->cread);
+    ck->cread = NULL;
+
+    return tmem;
+}
+
+static int
+config_file(const char *cfile)
+{
+    struct stat st;
+    int fd = open(cfile, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        diagx(DIAG_ERROR, NULL,
+                "could not open file: %s: %s", cfile, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    reindex = 0;
+    if (!st.st_size)
+    {
+        close(fd);
+        return 0;
+    }
+
+    char *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == m)
+    {
+        diagx(DIAG_ERROR, NULL,
+                "could not map file: %s: %s", cfile, strerror(errno));
+        return -1;
+    }
+    madvise(m, st.st_size, MADV_SEQUENTIAL);
+
+    config_scan(m, st.st_size);
+    munmap(m, st.st_size);
+    return 0;
+}
+
+int
+check_kconfigs(const char *cfile)
+{
+    CK_PROBE(check_entry, cfile);
+    config_state();
+    if (!postedit)
+    {
+        const char *name = strcmp(cfile, "-") ? cfile : "stdin";
+        cnames = realloc(cnames, (ncnames + 1) * sizeof(char *));
+        if (!cnames || !(cnames[ncnames] = strdup(name)))
+            failx("could not allocate config file name");
+        cname = cnames[ncnames++];
+    }
+
+    int r = strcmp(cfile, "-") ? config_file(cfile) : config_stdin();
+    CK_PROBE(check_return, cfile, r);
+
+    return r;
+}
@@ -14,39 +14,104 @@
  * See COPYING file or <http://www.gnu.org/licenses/> for more details.
  */
 
+#include <err.h>
 #include <stdio.h>
-#include <ctype.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
 #include <libgen.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
-#include <sys/resource.h>
 
-#include "configk.h"
-#include "parser.tab.h"
-#include "eparse.tab.h"
-#include "cparse.tab.h"
-
-extern FILE *yyin, *ccin;
-extern int yyparse(void);
-extern int ccparse(char *);
-extern int8_t eescans(uint8_t, const char *, char **);
+#include "libconfigk.h"
+#include "report.h"
 
 #define VERSION "0.3"
 
-uint16_t opts = 0;
-uint8_t postedit = 0;
-char *gstr[GSTRSZ] = {}; /* global string pointers */
-const char *types[] = { "", "int", "hex", "bool", "string", "tristate" };
-struct hsearch_data chash;
-static char *gets_range(const char *);
+/*
+ * configk works on one handle of libconfigk, see libconfigk.h. Its own
+ * options select an edit, a report or the form of the output; reports are
+ * in report.h.
+ */
+
+enum OPTS
+{
+     OUT_VERBOSE = 0x1,
+      OUT_CONFIG = 0x2,
+         OUTMASK = 0x40203,
+  DISABLE_CONFIG = 0x4,
+   ENABLE_CONFIG = 0x8,
+   TOGGLE_CONFIG = 0x10,
+        EDITMASK = 0x4021F,
+     SHOW_CONFIG = 0x20,
+    CHECK_CONFIG = 0x40,
+     EDIT_CONFIG = 0x80,
+    EDIT_INPLACE = 0x100,
+        OUT_JSON = 0x200,
+   IMPACT_CONFIG = 0x800,
+   SEARCH_CONFIG = 0x1000,
+   FPRINT_CONFIG = 0x2000,
+    TDIFF_CONFIG = 0x4000,
+    MINIM_CONFIG = 0x8000,
+   RANDOM_CONFIG = 0x10000,
+     LINT_CONFIG = 0x20000,
+     OUT_SUMMARY = 0x40000,
+   FILTER_CONFIG = 0x80000,
+    MTREE_CONFIG = 0x100000,
+    GRAPH_CONFIG = 0x200000,
+    SOLVE_CONFIG = 0x400000,
+ COMPLETE_CONFIG = 0x800000
+};
+
+enum ARGS
+{
+    APROG = 0x0,
+    ASOPT = 0x1,
+    ADOPT = 0x2,
+    AEOPT = 0x3,
+    AFOPT = 0x4,
+    ATOPT = 0x5,
+    AARCH = 0x6,
+    AEDTR = 0x7,
+    ATMPD = 0x8,
+    AGREP = 0x9,
+    AIMPT = 0xA,
+    ASRCH = 0xB,
+    AFPRT = 0xC,
+    ATDIF = 0xD,
+    ARAND = 0xE,
+    ASEED = 0xF,
+    AGRPH = 0x10,
+    ASOLV = 0x11,
+    ACOMP = 0x12,
+   ARGSSZ = 0x13
+};
+
+typedef struct
+{
+    const char **name;  /* held by the tree of the handle */
+    uint32_t n;
+    uint32_t sz;
+} nList; /* option names of a pattern */
+
+uint8_t ropts = 0;
+const char *rprog = NULL;
+const char *rgrep = NULL;
+
+static uint32_t copts = 0;
+static char *args[ARGSSZ];
+static ck_handle *ckh = NULL;
+static char **cfiles = NULL;    /* --check files, merged in this order */
+static uint16_t ncfiles = 0;
 
 static void
 usage(void)
 {
-    printf("Usage: %s [OPTIONS] <source-directory>\n", gstr[IPROG]);
+    printf("Usage: %s [OPTIONS] <source-directory> [<source-directory>...]\n",
+                                                                args[APROG]);
 }
 
 static void
@@ -56,19 +121,44 @@ printh(void)
     usage();
     printf("\nOptions:\n");
     printf(fmt, " -a --srcarch <arch>", "set $SRCARCH variable");
-    printf(fmt, " -c --check <file>", "check configs against the source tree");
+    printf(fmt, " -c --check <file>",
+                    "check configs against the source tree, repeat to merge");
     printf(fmt, " -C --config", "show output as a config file");
     printf(fmt, " -d --disable <option>", "disable config option");
+    printf(fmt, " -D --tree-diff <srcdir>",
+                    "show options changed since an old source tree");
     printf(fmt, " -e --enable <option>[=val]", "enable config option");
     printf(fmt, " -E --edit <file>", "edit config file with an $EDITOR");
+    printf(fmt, " -f --filter",
+                    "edit a config read from stdin, write it to stdout");
+    printf(fmt, " -F --fingerprint[=<file>]",
+                    "show config fingerprint, or files changed since <file>");
     printf(fmt, " -g --grep <[s:]string>",
                     "show config option with matching attribute");
+    printf(fmt, " -G --graph[=dot|bin]",
+                    "show cycles, chains and fan-in of the symbol graph");
     printf(fmt, " -h --help", "show help");
     printf(fmt, " -i --in-place <file>", "edit config file in place");
+    printf(fmt, " -I --impact <option>[=val]",
+                    "show what enabling or disabling (=n) an option changes");
+    printf(fmt, " -j --json", "show output as JSON objects, one per line");
+    printf(fmt, " -L --lint", "check the Kconfig tree for common mistakes");
+    printf(fmt, " -m --minimize", "show a minimal config of a --check file");
+    printf(fmt, " -p --complete <prefix>",
+                    "show option names beginning with <prefix>");
+    printf(fmt, " -r --randconfig <N>",
+                    "generate N random configs, one line per config");
+    printf(fmt, " -R --seed <S>", "first seed of --randconfig");
     printf(fmt, " -s --show <option>", "show a config option entry");
+    printf(fmt, " -S --search <string>",
+                    "search option names, prompts and help text");
     printf(fmt, " -t --toggle <option>", "toggle an option between y & m");
     printf(fmt, " -v --version", "show version");
+    printf(fmt, " -W --summary",
+                    "show only the count of warnings of each kind");
     printf(fmt, " -V --verbose", "show verbose output");
+    printf(fmt, " -x --solve <option>[=val]",
+                    "show the fewest changes which let an option be set");
     printf("\nReport issues at: https://github.com/pjps/config-kernel/\n");
 }
 
@@ -76,7 +166,7 @@ static uint8_t
 check_options(int argc, char *argv[])
 {
     int n;
-    char optstr[] = "+a:c:Cd:e:E:g:hi:s:t:vV";
+    char optstr[] = "+a:c:Cd:D:e:E:fF::g:G::hi:I:jLmp:r:R:s:S:t:vVWx:";
     extern int opterr, optind;
 
     struct option lopt[] = \
@@ -85,59 +175,102 @@ check_options(int argc, char *argv[])
         { "check", required_argument, NULL, 'c' },
         { "config", no_argument, NULL, 'C' },
         { "disable", required_argument, NULL, 'd' },
+        { "tree-diff", required_argument, NULL, 'D' },
         { "enable", required_argument, NULL, 'e' },
         { "edit", required_argument, NULL, 'E' },
+        { "filter", no_argument, NULL, 'f' },
+        { "fingerprint", optional_argument, NULL, 'F' },
         { "grep", required_argument, NULL, 'g' },
+        { "graph", optional_argument, NULL, 'G' },
         { "help", no_argument, NULL, 'h' },
         { "in-place", required_argument, NULL, 'i' },
+        { "impact", required_argument, NULL, 'I' },
+        { "json", no_argument, NULL, 'j' },
+        { "lint", no_argument, NULL, 'L' },
+        { "minimize", no_argument, NULL, 'm' },
+        { "complete", required_argument, NULL, 'p' },
+        { "randconfig", required_argument, NULL, 'r' },
+        { "seed", required_argument, NULL, 'R' },
         { "show", required_argument, NULL, 's' },
+        { "search", required_argument, NULL, 'S' },
         { "toggle", required_argument, NULL, 't' },
         { "version", no_argument, NULL, 'v' },
         { "verbose", no_argument, NULL, 'V' },
+        { "summary", no_argument, NULL, 'W' },
+        { "solve", required_argument, NULL, 'x' },
         { 0, 0, 0, 0 }
     };
 
-    opts = opterr = optind = 0;
+    copts = opterr = optind = 0;
     while ((n = getopt_long(argc, argv, optstr, lopt, &optind)) != -1)
     {
         switch (n)
         {
         case 'a':
-            free(gstr[IARCH]);
-            gstr[IARCH] = strdup(optarg);
+            free(args[AARCH]);
+            args[AARCH] = strdup(optarg);
             break;
 
         case 'c':
-            opts = CHECK_CONFIG | (opts & (EDITMASK|SHOW_CONFIG));
-            free(gstr[IFOPT]);
-            gstr[IFOPT] = strdup(optarg);
+            copts = CHECK_CONFIG
+                    | (copts & (EDITMASK|SHOW_CONFIG|IMPACT_CONFIG|FPRINT_CONFIG
+                            |MINIM_CONFIG|SOLVE_CONFIG|COMPLETE_CONFIG));
+            free(args[AFOPT]);
+            args[AFOPT] = strdup(optarg);
+            if (!(cfiles = realloc(cfiles, (ncfiles + 1) * sizeof(char *))))
+                err(-1, "could not allocate config file list");
+            cfiles[ncfiles++] = optarg;
             break;
 
         case 'C':
-            opts |= OUT_CONFIG;
+            copts |= OUT_CONFIG;
             break;
 
         case 'd':
-            opts = DISABLE_CONFIG | (opts & EDITMASK);
-            free(gstr[IDOPT]);
-            gstr[IDOPT] = strdup(optarg);
+            copts = DISABLE_CONFIG | (copts & (EDITMASK|FILTER_CONFIG));
+            free(args[ADOPT]);
+            args[ADOPT] = strdup(optarg);
+            break;
+
+        case 'D':
+            copts = TDIFF_CONFIG | (copts & OUTMASK);
+            free(args[ATDIF]);
+            args[ATDIF] = strdup(optarg);
             break;
 
         case 'e':
-            opts = ENABLE_CONFIG | (opts & EDITMASK);
-            free(gstr[IEOPT]);
-            gstr[IEOPT] = strdup(optarg);
+            copts = ENABLE_CONFIG | (copts & (EDITMASK|FILTER_CONFIG));
+            free(args[AEOPT]);
+            args[AEOPT] = strdup(optarg);
             break;
 
         case 'E':
-            opts = EDIT_CONFIG | (opts & OUTMASK);
-            free(gstr[IFOPT]);
-            gstr[IFOPT] = strdup(optarg);
+            copts = EDIT_CONFIG | (copts & OUTMASK);
+            free(args[AFOPT]);
+            args[AFOPT] = strdup(optarg);
+            break;
+
+        case 'f':
+            copts = FILTER_CONFIG | (copts & EDITMASK);
+            free(args[AFOPT]);
+            args[AFOPT] = strdup("-");
+            break;
+
+        case 'F':
+            copts = FPRINT_CONFIG | (copts & (EDITMASK|CHECK_CONFIG));
+            free(args[AFPRT]);
+            args[AFPRT] = optarg ? strdup(optarg) : NULL;
             break;
 
         case 'g':
-            free(gstr[IGREP]);
-            gstr[IGREP] = strdup(optarg);
+            free(args[AGREP]);
+            args[AGREP] = strdup(optarg);
+            break;
+
+        case 'G':
+            copts = GRAPH_CONFIG | (copts & OUTMASK);
+            free(args[AGRPH]);
+            args[AGRPH] = optarg ? strdup(optarg) : NULL;
             break;
 
         case 'h':
@@ -145,29 +278,80 @@ check_options(int argc, char *argv[])
             exit(0);
 
         case 'i':
-            opts = EDIT_INPLACE | (opts & EDITMASK);
-            free(gstr[IFOPT]);
-            gstr[IFOPT] = strdup(optarg);
+            copts = EDIT_INPLACE | (copts & EDITMASK);
+            free(args[AFOPT]);
+            args[AFOPT] = strdup(optarg);
+            break;
+
+        case 'I':
+            copts = IMPACT_CONFIG | (copts & (OUTMASK|CHECK_CONFIG));
+            free(args[AIMPT]);
+            args[AIMPT] = strdup(optarg);
+            break;
+
+        case 'j':
+            copts |= OUT_JSON;
+            break;
+
+        case 'L':
+            copts = LINT_CONFIG | (copts & OUTMASK);
+            break;
+
+        case 'm':
+            copts = MINIM_CONFIG | (copts & (OUTMASK|CHECK_CONFIG));
+            break;
+
+        case 'p':
+            copts = COMPLETE_CONFIG | (copts & (OUTMASK|CHECK_CONFIG));
+            free(args[ACOMP]);
+            args[ACOMP] = strdup(optarg);
+            break;
+
+        case 'r':
+            copts = RANDOM_CONFIG | (copts & OUTMASK);
+            free(args[ARAND]);
+            args[ARAND] = strdup(optarg);
+            break;
+
+        case 'R':
+            free(args[ASEED]);
+            args[ASEED] = strdup(optarg);
             break;
 
         case 's':
-            opts = SHOW_CONFIG | (opts & (OUTMASK|CHECK_CONFIG));
-            free(gstr[ISOPT]);
-            gstr[ISOPT] = strdup(optarg);
+            copts = SHOW_CONFIG | (copts & (OUTMASK|CHECK_CONFIG));
+            free(args[ASOPT]);
+            args[ASOPT] = strdup(optarg);
+            break;
+
+        case 'S':
+            copts = SEARCH_CONFIG | (copts & OUTMASK);
+            free(args[ASRCH]);
+            args[ASRCH] = strdup(optarg);
             break;
 
         case 't':
-            opts = TOGGLE_CONFIG | (opts & EDITMASK);
-            free(gstr[ITOPT]);
-            gstr[ITOPT] = strdup(optarg);
+            copts = TOGGLE_CONFIG | (copts & (EDITMASK|FILTER_CONFIG));
+            free(args[ATOPT]);
+            args[ATOPT] = strdup(optarg);
             break;
 
         case 'v':
-            printf("%s version %s\n", gstr[IPROG], VERSION);
+            printf("%s version %s\n", args[APROG], VERSION);
             exit(0);
 
         case 'V':
-            opts |= OUT_VERBOSE;
+            copts |= OUT_VERBOSE;
+            break;
+
+        case 'W':
+            copts |= OUT_SUMMARY;
+            break;
+
+        case 'x':
+            copts = SOLVE_CONFIG | (copts & (OUTMASK|CHECK_CONFIG));
+            free(args[ASOLV]);
+            args[ASOLV] = strdup(optarg);
             break;
 
         default:
@@ -181,35 +365,53 @@ check_options(int argc, char *argv[])
 static void
 _init(int argc, char *argv[])
 {
-    struct rlimit rs;
-
-    gstr[IPROG] = strdup(argv[0]);
+    args[APROG] = strdup(argv[0]);
     if (argc <= check_options(argc, argv))
     {
         usage();
         exit(0);
     }
+    if ((copts & MINIM_CONFIG) && !(copts & CHECK_CONFIG))
+        errx(-1, "--minimize needs a config file, see --check");
+    if ((copts & (EDIT_CONFIG|EDIT_INPLACE)) && !strcmp(args[AFOPT], "-"))
+        errx(-1, "can not edit the standard input, see --filter");
+    if ((copts & FILTER_CONFIG) && (copts & OUT_JSON))
+        errx(-1, "--json can not be used with --filter, both write stdout");
+    if ((copts & CHECK_CONFIG) && argc - optind > 1)
+    {
+        if (copts & (DISABLE_CONFIG|ENABLE_CONFIG|TOGGLE_CONFIG|SHOW_CONFIG
+                    |IMPACT_CONFIG|FPRINT_CONFIG|MINIM_CONFIG|SOLVE_CONFIG
+                    |COMPLETE_CONFIG|OUT_CONFIG))
+            errx(-1, "several source trees can only be checked, see --check");
+        for (uint16_t i = 0; i < ncfiles; i++)
+            if (!strcmp(cfiles[i], "-"))
+                errx(-1, "can not check the standard input in several trees");
+        copts |= MTREE_CONFIG;
+    }
 
-    getrlimit(RLIMIT_NOFILE, &rs);
-    rs.rlim_cur = 2048;
-    if (setrlimit(RLIMIT_NOFILE, &rs))
-        err(-1, "could not set open files limit to: %lu", rs.rlim_cur);
+    args[AEDTR] = getenv("EDITOR");
+    args[AEDTR] = args[AEDTR] ? strdup(args[AEDTR]) : strdup("vi");
 
-    memset(&chash, '\0', sizeof(chash));
-    if (!hcreate_r(HASHSZ, &chash))
-        err(-1, "could not create chash table");
+    args[ATMPD] = getenv("TMPDIR");
+    args[ATMPD] = args[ATMPD] ? strdup(args[ATMPD]) : strdup("/tmp");
 
-    gstr[IEDTR] = getenv("EDITOR");
-    gstr[IEDTR] = gstr[IEDTR] ? strdup(gstr[IEDTR]) : strdup("vi");
+    rprog = args[APROG];
+    rgrep = args[AGREP];
+    ropts = (copts & OUT_VERBOSE ? R_VERBOSE : 0)
+            | (copts & OUT_CONFIG ? R_CONFIG : 0)
+            | (copts & CHECK_CONFIG ? R_CHECK : 0)
+            | (copts & OUT_JSON ? R_JSON : 0)
+            | (copts & OUT_SUMMARY ? R_SUMMARY : 0);
 
-    gstr[ITMPD] = getenv("TMPDIR");
-    gstr[ITMPD] = gstr[ITMPD] ? strdup(gstr[ITMPD]) : strdup("/tmp");
+    if (!(ckh = ck_open(args[AARCH])))
+        err(-1, "could not create configk handle");
+    ck_set_flags(ckh, copts & OUT_VERBOSE ? CK_VERBOSE : 0);
+    ck_set_diag(ckh, diag_report, NULL);
+    ck_set_trace(ckh, edit_trace, NULL);
 
-    if (!gstr[IARCH])
-    {
-        gstr[IARCH] = getenv("SRCARCH");
-        gstr[IARCH] = gstr[IARCH] ? strdup(gstr[IARCH]) : strdup("x86");
-    }
+    if (copts & OUT_JSON)
+        json_init();
+    diag_start();
 
     return;
 }
@@ -217,463 +419,142 @@ _init(int argc, char *argv[])
 static void
 _reset(void)
 {
-    uint32_t tmem = 0;
-
-    tmem = tree_reset(tree_root());
-    tmem += (HASHSZ * sizeof(chash));
-    hdestroy_r(&chash);
-    for (uint8_t n = 0; n < GSTRSZ; n++)
-    {
-        tmem += gstr[n] ? strlen(gstr[n]) : 0;
-        free(gstr[n]);
-    }
-
-    if (!(opts & (SHOW_CONFIG|EDIT_CONFIG|EDIT_INPLACE)) && opts & OUT_CONFIG)
+    uint32_t o = copts;
+    uint32_t tmem = ck_release(ckh);
+
+    diag_free();
+    free(cfiles);
+    for (uint8_t n = 0; n < ARGSSZ; n++)
+        free(args[n]);
+
+    if (o & (IMPACT_CONFIG|SEARCH_CONFIG|FPRINT_CONFIG|TDIFF_CONFIG
+            |MINIM_CONFIG|RANDOM_CONFIG|LINT_CONFIG|FILTER_CONFIG
+            |MTREE_CONFIG|GRAPH_CONFIG|SOLVE_CONFIG|COMPLETE_CONFIG))
+        ;
+    else if (!(o & (SHOW_CONFIG|EDIT_CONFIG|EDIT_INPLACE))
+        && o & (OUT_CONFIG|OUT_JSON))
         fprintf(stderr, "Config memory: %.2f MB\n", (float)tmem / 1024 / 1024);
-    else if (!(opts & (SHOW_CONFIG | EDIT_CONFIG | EDIT_INPLACE)))
+    else if (!(o & (SHOW_CONFIG | EDIT_CONFIG | EDIT_INPLACE)))
         printf("Config memory: %.2f MB\n", (float)tmem / 1024 / 1024);
     return;
 }
 
-cNode *
-filenode(cNode *c)
+/* a report's result: 0, or 1 if it failed or found problems */
+static int
+report(int r)
 {
-    while (c->type != SENTRY)
-        c = c->up;
-    return c;
+    if (r < 0)
+        warnx("%s", ck_error(ckh));
+    return !!r;
 }
 
 static void
-show_configs(const char *sopt)
+trace_head(const char *msg)
 {
-    cNode *r = NULL;
-    cEntry *t = NULL;
-    sEntry *s = NULL;
-
-    if (!(r = hsearch_kconfigs(sopt)))
-    {
-        warnx("option '%s' not found in the source tree", sopt);
-        return;
-    }
-    t = (cEntry *)r->data;
-    s = (sEntry *)filenode(r)->data;
-
-    printf("%-7s: %s\n", "File", s->fname);
-    printf("%-7s: %s\n", "Config", t->opt_name);
-    printf("%-7s: %s\n", "Type", types[t->opt_type]);
-    if (t->opt_range)
-    {
-        char *range = gets_range(t->opt_range);
-        printf("%-7s: %s => [%s]\n", "Range", t->opt_range, range);
-        free(range);
-    }
-    if (t->opt_value)
-        printf("%-7s: %s\n", "Default", t->opt_value);
-    if (t->opt_prompt)
-        printf("%-7s: %s\n", "Prompt", t->opt_prompt);
-    if (t->opt_depends)
-    {
-        int8_t r = check_depends(t->opt_name);
-        printf("%-7s: %s => %d\n", "Depends", t->opt_depends, r);
-    }
-    if (t->opt_select)
-        printf("%-7s: %s\n", "Select", t->opt_select);
-    if (t->opt_imply)
-        printf("%-7s: %s\n", "Imply", t->opt_imply);
-    if (t->opt_help)
-        printf("%-7s:\n%s\n", "Help", t->opt_help);
-    printf("\n");
-
+    if (!(copts & OUT_JSON))
+        fprintf(stderr, "%s\n", msg);
     return;
 }
 
-char *
-append(char *dst, char *src)
-{
-#define CDLM    ";\n\t" /* delimiter for select/depends list */
-    char *tmp = NULL;
-    uint16_t slen = strlen(src);
-    uint16_t dlen = dst ? strlen(dst) + 4 : 1;
-
-    tmp = calloc(slen + dlen, sizeof(char));
-    if (tmp && dst)
-    {
-        strcpy(tmp, dst);
-        strncat(tmp, CDLM, 4);
-        free(dst);
-    }
-    else if (!tmp)
-        err(-1, "could not allocate memory for: '%s'", src);
-
-    return strncat(tmp, src, slen);
-}
-
-cEntry *
-add_new_config(char *cid, nType ctype)
+/* iterator of ck_match(): collect the names, they are used after it */
+static int
+match_name(const ck_option *o, void *arg)
 {
-    ENTRY e, *r;
-    cEntry *t = NULL;
+    nList *l = arg;
 
-    e.key = cid;
-    if (hsearch_r(e, FIND, &r, &chash))
+    if (l->n == l->sz)
     {
-        if (opts & OUT_VERBOSE)
-            warnx("'%s' read again, use earlier object", r->key);
-        t = ((cNode *)r->data)->data;
-        if (!t)
-            err(-1, "'%s' data object is %p", r->key, t);
-        free(cid);
-        return t;
+        l->sz = l->sz ? l->sz * 2 : 64;
+        if (!(l->name = realloc(l->name, l->sz * sizeof(char *))))
+            err(-1, "could not allocate option list");
     }
+    l->name[l->n++] = o->name;
 
-    t = calloc(1, sizeof(cEntry));
-    t->opt_name = cid;
-
-    e.data = tree_add(tree_cnode(t, ctype));
-    if (!hsearch_r(e, ENTER, &r, &chash))
-        err(-1, "could not hash option '%s' %p", e.key, r);
-
-    return t;
-}
-
-static int
-read_kconfigs(const char *srcdir)
-{
-    char *wd = getcwd(NULL, 0);
-    if (!wd)
-        err(-1, "could not get cwd");
-    if (chdir(srcdir))
-        err(-1, "could not change cwd: %s", srcdir);
-
-    FILE *fin = fopen("Kconfig", "r");
-    if (!fin)
-        err(-1, "could not open file: %s/%s", srcdir, "Kconfig");
-
-    yyin = fin;
-    tree_init("Kconfig");
-
-    yyparse();
-    fclose(fin);
-    if (chdir(wd))
-        err(-1, "could not chage to oldwd: %s", wd);
-
-    free(wd);
     return 0;
 }
 
 static void
-list_kconfigs(void)
+show_block(const char *expr, int value, void *arg)
 {
-    FILE *out = stderr;
-    cNode *r = tree_root();
-
-    if (opts & OUT_CONFIG && opts & CHECK_CONFIG)
-    {
-        printf("# This file is generated by %s\n", gstr[IPROG]);
-        tree_display_config(r);
-    }
-    else if (opts & OUT_CONFIG)
-        tree_display_config(r);
-    else
-    {
-        tree_display(r);
-        out = stdout;
-    }
-
-    fprintf(out, "Config files: %d\n", ((sEntry *)r->data)->s_count);
-    fprintf(out, "Config options: %d\n", ((sEntry *)r->data)->o_count);
+    (void)arg;
+    printf("%-7s: %s => %d\n", "Block", expr, value);
     return;
 }
 
-cNode *
-hsearch_kconfigs(const char *copt)
-{
-    ENTRY e, *r;
-
-    e.data = NULL;
-    e.key = (char *)copt;
-    if (!hsearch_r(e, FIND, &r, &chash))
-        return NULL;
-
-    return (cNode *)r->data;
-}
-
-static char *
-gets_range(const char *exp)
-{
-    char *rxp, *txp, *tok, *svp;
-
-    rxp = NULL;
-    txp = strdup(exp);
-    tok = strtok_r(txp, CDLM, &svp);
-    while (tok)
-    {
-        uint8_t l = (rxp ? strlen(rxp) : 0) + strlen(tok) + 8;
-        char *t = calloc(l, sizeof(uint8_t));
-
-        if (rxp)
-        {
-            snprintf(t, l, "%.200s;range %s", rxp, tok);
-            free(rxp);
-        }
-        else
-            snprintf(t, l, "range %s", tok);
-
-        rxp = t;
-        tok = strtok_r(NULL, CDLM, &svp);
-    }
-    free(txp);
-
-    char *rng = calloc(64, sizeof(uint8_t));
-    eescans(EXPR_RANGE, rxp, &rng);
-    //int8_t r =
-    //warnx("%s: %s(%d): %d=>%s", __func__, rxp, strlen(rxp), r, rng);
-
-    free(rxp);
-    return rng;
-}
-
-static uint8_t
-validate_range(long val, const char *rexp)
-{
-    long r1, r2;
-    char *range = gets_range(rexp);
-
-    sscanf(range, "%li %li", &r1, &r2);
-    free(range);
-
-    return (r1 <= val && val <= r2);
-}
-
-int8_t
-validate_option(const char *opt)
+static int
+show_config(const char *name)
 {
-    char *val;
-    int8_t l, rangerr = 17;
-
-    cNode *c = hsearch_kconfigs(opt);
-    cEntry *t = (cEntry *)c->data;
-
-    val = t->opt_value;
-    t->opt_status = t->opt_type;
-    switch (t->opt_type)
-    {
-    case CINT:
-        long v = atoi(val);
-        if (*val != '0' && !v)
-            t->opt_status = -t->opt_type;
-        else if (t->opt_range && !validate_range(v, t->opt_range))
-            t->opt_status = -rangerr;
-        break;
-
-    case CBOOL:
-        l = strlen(val);
-        if (l > 1 || !strstr("yYnN", val))
-            t->opt_status = -t->opt_type;
-        else if ('n' == *val || 'N' == *val)
-            t->opt_status = -CVALNOSET;
-        break;
-
-    case CTRISTATE:
-        l = strlen(val);
-        if (l > 1 || !strstr("yYnNmM", val))
-            t->opt_status = -t->opt_type;
-        else if ('n' == *val || 'N' == *val)
-            t->opt_status = -CVALNOSET;
-        break;
-
-    case CHEX:
-        l = strlen(val);
-        if (l > 18 || val[0] != '0' || (val[1] != 'x' && val[1] != 'X'))
-            t->opt_status = -t->opt_type;
-        if (t->opt_status > 0)
-        {
-            char *c = val + 2;
-            while (*c && isxdigit(*c)) c++;
-            if (*c)
-                t->opt_status = -t->opt_type;
-        }
-        if (t->opt_status > 0 && t->opt_range)
-        {
-            long v = strtol(val, NULL, 0);
-            if (!validate_range(v, t->opt_range))
-                t->opt_status = -rangerr;
-        }
-        break;
+    int dep = -1;
+    ck_option o;
 
-    default: ;
-    }
-    if ((int8_t)-t->opt_type == t->opt_status)
-        warnx("option '%s' has invalid %s value: '%s'",
-                                        opt, types[t->opt_type], val);
-    if (-rangerr == t->opt_status)
+    if (ck_lookup(ckh, name, &o) || ck_depends(ckh, name, &dep))
+        return report(-1);
+    if (copts & OUT_JSON)
     {
-        warnx("option '%s' has out of range value: '%s'", opt, val);
-        t->opt_status = -t->opt_type;
-    }
-
-    return t->opt_status;
-}
-
-int8_t
-set_option(const char *opt, char *val)
-{
-    cNode *c = hsearch_kconfigs(opt);
-    if (!c)
+        json_option(&o, dep, true);
         return 0;
-
-    cEntry *t = (cEntry *)c->data;
-    if (val)
-    {
-        free(t->opt_value);
-        t->opt_value = strdup(val);
     }
-    else if (t->opt_value)
+
+    printf("%-7s: %s\n", "File", o.file);
+    printf("%-7s: %s\n", "Config", o.name);
+    printf("%-7s: %s\n", "Type", o.type);
+    if (o.range)
     {
-        val = strdup("n");
-        int r = eescans(EXPR_DEFAULT, t->opt_value, &val);
-        if (val && r)
-        {
-            free(t->opt_value);
-            t->opt_value = val;
-        }
+        char *range = NULL;
+        if (ck_range(ckh, name, &range))
+            return report(-1);
+        printf("%-7s: %s => [%s]\n", "Range", o.range, range);
+        free(range);
     }
-    if (!strcmp(t->opt_value, "is not set"))
-        return t->opt_status = -CVALNOSET;
+    if (o.value)
+        printf("%-7s: %s\n", "Default", o.value);
+    if (o.prompt)
+        printf("%-7s: %s\n", "Prompt", o.prompt);
+    if (o.depends)
+        printf("%-7s: %s => %d\n", "Depends", o.depends, dep);
+    if (ck_blocks(ckh, name, show_block, NULL))
+        return report(-1);
+    if (o.select)
+        printf("%-7s: %s\n", "Select", o.select);
+    if (o.imply)
+        printf("%-7s: %s\n", "Imply", o.imply);
+    if (o.help)
+        printf("%-7s:\n%s\n", "Help", o.help);
+    printf("\n");
 
-    ((sEntry *)filenode(c)->data)->u_count++;
-    return validate_option(opt);
+    return 0;
 }
 
-int8_t
-check_depends(const char *sopt)
+/* show option 'sopt', or each option matching it as a glob pattern */
+static int
+show_configs(const char *sopt)
 {
-    int8_t r = -1;
-    cNode *c = hsearch_kconfigs(sopt);
-    cEntry *t = (cEntry *)c->data;
-    if (!t->opt_depends)
-        return r;
+    int r = 0;
+    nList l = { NULL, 0, 0 };
 
-    if (opts & OUT_VERBOSE)
-        fprintf(stderr, "%s depends on %s: ", t->opt_name, t->opt_depends);
-    r = eescans(EXPR_DEPENDS, t->opt_depends, NULL);
-    if (opts & OUT_VERBOSE)
-        fprintf(stderr, ":=> %d\n", r);
+    if (ck_match(ckh, sopt, match_name, &l))
+        r = report(-1);
+    for (uint32_t i = 0; i < l.n; i++)
+        r |= show_config(l.name[i]);
+    free(l.name);
 
     return r;
 }
 
-int8_t
-toggle_configs(const char *sopt, uint8_t status, char *val, bool recursive)
-{
-    static uint8_t sp = 0;
-    extern uint8_t cache_redits(cEntry *);
-
-    cNode *c = hsearch_kconfigs(sopt);
-    if (!c)
-    {
-        warnx("'%s' not found in the options' list", sopt);
-        return 0;
-    }
-    cEntry *t = (cEntry *)c->data;
-    if (ENABLE_CONFIG == status)
-        set_option(sopt, val);
-    if (TOGGLE_CONFIG == status)
-    {
-        if (t->opt_status && CTRISTATE == t->opt_type)
-        {
-            if ('y' == tolower(*t->opt_value))
-                *t->opt_value = 'm';
-            else if ('m' == tolower(*t->opt_value))
-                *t->opt_value = 'y';
-        }
-        else
-        {
-            warnx("option '%s' is disabled or is not tristate, skip toggle",
-                    t->opt_name);
-            return 0;
-        }
-    }
-    if (DISABLE_CONFIG == status)
-        t->opt_status = -CVALNOSET;
-
-    if (!recursive)
-        return 1;
-
-    if (t->opt_status && t->opt_status != -CVALNOSET
-        && !check_depends(t->opt_name))
-        warnx("option dependency not met for '%s'", t->opt_name);
-
-    sp += 2;
-    for (int i = 0; i < sp; i++)
-        fprintf(stderr, " ");
-    fprintf(stderr, "%s\n", t->opt_name);
-    if (postedit)
-        cache_redits(t);
-    if (t->opt_select)
-        eescans(status, t->opt_select, &val);
-    if (t->opt_imply)
-        eescans(status, t->opt_imply, &val);
-
-    /* boolean choice: enable one and disable others */
-    if (c->up->type == CHENTRY && t->opt_type == CBOOL)
-    {
-        if (ENABLE_CONFIG == status && t->opt_status > 0)
-        {
-            for (int i = 0; i < sp; i++)
-                fprintf(stderr, " ");
-            fprintf(stderr, "Disable option:\n");
-            c = c->up->down;
-            while (c)
-            {
-                cEntry *ch = (cEntry *)c->data;
-                if (ch->opt_status > 0 && ch != t)
-                    toggle_configs(ch->opt_name, DISABLE_CONFIG, NULL, true);
-                c = c->next;
-            }
-        }
-        if (DISABLE_CONFIG == status && t->opt_status < 0)
-        {
-            uint8_t ech = 0;
-            c = c->up->down;
-            while (c)
-            {
-                cEntry *ch = (cEntry *)c->data;
-                if (ch->opt_status > 0)
-                    ech += 1;
-                c = c->next;
-            }
-
-            if (!ech)
-            {
-             /*
-              * char *val = strdup("n");
-              * t = (cEntry *)c->up->data;
-              * int r = eescans(EXPR_DEFAULT, t->opt_value, &val);
-              * if (r)
-              *     toggle_configs(val, ENABLE_CONFIG, "y");
-              */
-                warnx("last choice '%s' disabled, none enabled now",
-                        t->opt_name);
-            }
-        }
-    }
-    sp -= 2;
-    return 1;
-}
-
+/* edit option 'sopt', or each option matching it as a glob pattern */
 static int
-check_kconfigs(const char *cfile)
+edit_configs(const char *sopt, int edit, const char *val)
 {
-    char r = 11;
-    FILE *fin = fopen(cfile, "r");
-    if (!fin)
-        err(-1, "could not open file: %s", cfile);
+    int r = 0;
+    nList l = { NULL, 0, 0 };
 
-    ccin = fin;
-    ccparse(&r);
+    if (ck_match(ckh, sopt, match_name, &l))
+        r = report(-1);
+    for (uint32_t i = 0; i < l.n; i++)
+        if (ck_edit(ckh, l.name[i], edit, val))
+            r = report(-1);
+    free(l.name);
 
-    fclose(fin);
     return r;
 }
 
@@ -736,30 +617,34 @@ copy_file(const char *dst, const char *src)
     return s.st_size;
 }
 
-static void
+/* write the config 'sopt' with the values of the tree, in place */
+static int
 edit_iconfigs(const char *sopt)
 {
     char tmp[20];
-    int32_t fd, st;
+    int32_t fd, r;
+    FILE *fp;
 
-    snprintf(tmp, sizeof(tmp), "%s/%s", gstr[ITMPD], "cXXXXXXX");
+    snprintf(tmp, sizeof(tmp), "%s/%s", args[ATMPD], "cXXXXXXX");
     if ((fd = mkstemp(tmp)) < 0)
         err(-1, "could not create a temporary file: %s", tmp);
-    close(fd);
+    if (!(fp = fdopen(fd, "w")))
+        err(-1, "could not open file: %s", tmp);
 
-    postedit = SHOW_CONFIG;
-    fd = open(tmp, O_WRONLY|O_TRUNC|O_DSYNC);
-    st = dup(STDOUT_FILENO);
-    dup2(fd, STDOUT_FILENO);
-    check_kconfigs(sopt);
-    fflush(stdout);
-    close(fd);
-    dup2(st, STDOUT_FILENO);
-    close(st);
+    r = report(ck_write_config(ckh, sopt, fp));
+    fclose(fp);
 
-    copy_file(sopt, tmp);
+    if (!r)
+        copy_file(sopt, tmp);
     unlink(tmp);
-    return;
+    return r;
+}
+
+/* write the config read from stdin with its edits, see ck_write_config() */
+static int
+filter_configs(void)
+{
+    return report(ck_write_config(ckh, "-", stdout));
 }
 
 static void
@@ -769,7 +654,7 @@ edit_kconfigs(const char *sopt)
     struct stat s;
     char cmd[20], tmp[20];
 
-    snprintf(cmd, sizeof(cmd), "%s/%s", "/usr/bin", gstr[IEDTR]);
+    snprintf(cmd, sizeof(cmd), "%s/%s", "/usr/bin", args[AEDTR]);
     if (stat(cmd, &s) < 0)
         err(-1, "editor %s not found", cmd);
     if (S_IFREG != (s.st_mode & S_IFMT) || !(s.st_mode & S_IXOTH))
@@ -780,7 +665,7 @@ edit_kconfigs(const char *sopt)
         err(-1, "could not set parent pgid");
     signal(SIGTTOU, SIG_IGN);
 
-    snprintf(tmp, sizeof(tmp), "%s/%s", gstr[ITMPD], "cXXXXXXX");
+    snprintf(tmp, sizeof(tmp), "%s/%s", args[ATMPD], "cXXXXXXX");
     if ((fd = mkstemp(tmp)) < 0)
         err(-1, "could not create a temporary file: %s", tmp);
     close(fd);
@@ -806,16 +691,29 @@ editc:
 
     waitpid(pid, &st, 0);
     setforeground();
-    postedit = EDIT_CONFIG;
-    fprintf(stderr, "-----\n");
-    check_kconfigs(tmp);
     fprintf(stderr, "-----\n");
+    report(ck_apply_config(ckh, tmp));
     edit_iconfigs(tmp);
+    diag_flush();
+    fprintf(stderr, "-----\n");
 
     uint8_t r;
-    printf("Do you wish to exit?[y/N]: ");
+askc:
+    printf("Do you wish to exit?[y/N/u(ndo)]: ");
     fflush(stdout);
     r = fgetc(stdin); fgetc(stdin);
+    if (r == 'u' || r == 'U')
+    {
+        if (ck_undo(ckh, 1) <= 0)
+            warnx("no edits to undo");
+        else
+        {
+            edit_iconfigs(tmp);
+            diag_flush();
+            warnx("last edit undone");
+        }
+        goto askc;
+    }
     if (r == 'n' || r == 'N' || r == '\n')
         goto editc;
 
@@ -825,46 +723,113 @@ ext:
     return;
 }
 
+static int
+complete_name(const char *name, void *arg)
+{
+    (void)arg;
+    if (copts & OUT_JSON)
+        json_complete(name);
+    else
+        puts(name);
+
+    return 0;
+}
+
 int
 main(int argc, char *argv[])
 {
+    int r = 0;
+
     _init(argc, argv);
 
-    read_kconfigs(argv[optind]);
-    if (opts & (CHECK_CONFIG | EDIT_CONFIG | EDIT_INPLACE))
-        check_kconfigs(gstr[IFOPT]);
+    /* each tree is loaded by a worker process, see mtree.c */
+    if (copts & MTREE_CONFIG)
+    {
+        r = !!mtree_kconfigs(args[AARCH], argv + optind, argc - optind,
+                                                            cfiles, ncfiles);
+        diag_flush();
+        _reset();
+        return r;
+    }
+    /* names are read from the symbol index, no file is parsed */
+    if ((copts & COMPLETE_CONFIG) && !(copts & CHECK_CONFIG))
+    {
+        r = report(ck_complete(ckh, argv[optind], args[ACOMP],
+                                                    complete_name, NULL));
+        diag_flush();
+        _reset();
+        return r;
+    }
 
-    if (opts & DISABLE_CONFIG)
+    /* an option is shown from the files it needs, unless values are read */
+    if ((copts & SHOW_CONFIG) && !(copts & CHECK_CONFIG)
+        && !strpbrk(args[ASOPT], "*?[")
+        ? ck_load_symbol(ckh, argv[optind], args[ASOPT])
+        : ck_load_tree(ckh, argv[optind]))
+        errx(-1, "%s", ck_error(ckh));
+    /* --check files are merged in one tree, a later value wins */
+    for (uint16_t i = 0; (copts & CHECK_CONFIG) && i < ncfiles; i++)
+        if (ck_load_config(ckh, cfiles[i]))
+            errx(-1, "%s", ck_error(ckh));
+    if (!(copts & CHECK_CONFIG)
+        && copts & (EDIT_CONFIG | EDIT_INPLACE | FILTER_CONFIG)
+        && ck_load_config(ckh, args[AFOPT]))
+        errx(-1, "%s", ck_error(ckh));
+
+    if (copts & DISABLE_CONFIG)
     {
-        fprintf(stderr, "Disable option:\n");
-        toggle_configs(gstr[IDOPT], DISABLE_CONFIG, NULL, true);
+        trace_head("Disable option:");
+        r |= edit_configs(args[ADOPT], CK_DISABLE, NULL);
     }
-    if (opts & ENABLE_CONFIG)
+    if (copts & ENABLE_CONFIG)
     {
-        char *val = NULL;
-        if (strchr(gstr[IEOPT], '='))
+        char *opt = args[AEOPT], *val = NULL;
+        if (strchr(opt, '='))
         {
-            gstr[IEOPT] = strtok(gstr[IEOPT], "=");
+            opt = strtok(opt, "=");
             val = strtok(NULL, "=");
         }
-        fprintf(stderr, "Enable option:\n");
-        toggle_configs(gstr[IEOPT], ENABLE_CONFIG, val, true);
+        trace_head("Enable option:");
+        r |= edit_configs(opt, CK_ENABLE, val);
     }
-    if (opts & TOGGLE_CONFIG)
+    if (copts & TOGGLE_CONFIG)
     {
-        fprintf(stderr, "Toggle option:\n");
-        toggle_configs(gstr[ITOPT], TOGGLE_CONFIG, NULL, true);
+        trace_head("Toggle option:");
+        r |= report(ck_edit(ckh, args[ATOPT], CK_TOGGLE, NULL));
     }
 
-    if (opts & EDIT_CONFIG)
-        edit_kconfigs(gstr[IFOPT]);
-    else if (opts & EDIT_INPLACE)
-        edit_iconfigs(gstr[IFOPT]);
-    else if (opts & SHOW_CONFIG)
-        show_configs(gstr[ISOPT]);
+    if (copts & EDIT_CONFIG)
+        edit_kconfigs(args[AFOPT]);
+    else if (copts & EDIT_INPLACE)
+        r |= edit_iconfigs(args[AFOPT]);
+    else if (copts & FILTER_CONFIG)
+        r |= filter_configs();
+    else if (copts & SHOW_CONFIG)
+        r |= show_configs(args[ASOPT]);
+    else if (copts & IMPACT_CONFIG)
+        r |= report(impact_configs(ckh, args[AIMPT]));
+    else if (copts & SEARCH_CONFIG)
+        r |= report(search_kconfigs(ckh, args[ASRCH]));
+    else if (copts & FPRINT_CONFIG)
+        r |= report(fprint_kconfigs(ckh, args[AFPRT]));
+    else if (copts & TDIFF_CONFIG)
+        r |= report(tdiff_kconfigs(ckh, args[ATDIF]));
+    else if (copts & MINIM_CONFIG)
+        r |= report(minimize_kconfigs(ckh));
+    else if (copts & RANDOM_CONFIG)
+        r |= report(random_kconfigs(ckh, args[ARAND], args[ASEED]));
+    else if (copts & LINT_CONFIG)
+        r |= report(lint_kconfigs(ckh));
+    else if (copts & GRAPH_CONFIG)
+        r |= report(depgraph_kconfigs(ckh, args[AGRPH]));
+    else if (copts & SOLVE_CONFIG)
+        r |= report(solve_configs(ckh, args[ASOLV]));
+    else if (copts & COMPLETE_CONFIG)
+        r |= report(ck_complete(ckh, NULL, args[ACOMP], complete_name, NULL));
     else
-        list_kconfigs();
+        r |= report(list_kconfigs(ckh));
 
+    diag_flush();
     _reset();
-    return 0;
+    return r;
 }
@@ -15,6 +15,7 @@
  */
 
 #include <err.h>
+#include <setjmp.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
@@ -23,12 +24,32 @@
 #define __USE_GNU
 #include <search.h>
 
+#include "libconfigk.h"
+
+/*
+ * USDT probes of the 'configk' provider, for perf(1) and bpftrace(8). They
+ * are built in when <sys/sdt.h> is found, unless -DCK_NO_SDT is given, and
+ * are a single nop instruction until a probe is attached.
+ */
+#if !defined(CK_NO_SDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CK_PROBE(...) STAP_PROBEV(configk, __VA_ARGS__)
+#endif
+#endif
+#ifndef CK_PROBE
+#define CK_PROBE(...)
+#endif
+
 typedef struct
 {
     char *fname;
     uint16_t s_count;
     uint16_t o_count;
     uint16_t u_count;
+    uint8_t f_stale;    /* fingerprint hashes to recompute */
+    uint64_t f_own;     /* fingerprint of own options */
+    uint64_t f_sub;     /* fingerprint of the file subtree */
 } sEntry; /* source entry */
 
 
@@ -42,6 +63,17 @@ typedef enum
     CVALNOSET=0x6
 } cType; /* config value type */
 
+typedef struct ch_group chGroup; /* see choice.c */
+
+typedef struct b_cond
+{
+    char *expr;             /* 'if' or menu 'depends on' expression */
+    struct b_cond *up;      /* enclosing block */
+    struct b_cond *next;    /* all blocks, see block_free() */
+    int8_t value;
+    uint32_t gen;           /* value is valid while gen == ck->vgen */
+} bCond; /* if/endif, menu/endmenu block condition */
+
 typedef struct
 {
     char *opt_name;
@@ -52,8 +84,17 @@ typedef struct
     char *opt_imply;
     char *opt_range;
     char *opt_help;
+    char *opt_default;      /* 'default' attribute once a value is set */
+    const char *opt_dfile;  /* file of the last definition */
+    uint16_t opt_ndef;      /* definitions read, see add_new_config() */
+    const char *opt_cfile;  /* config file and line which set its value */
+    uint32_t opt_cline;
     cType opt_type;
     int32_t opt_status;
+    uint32_t opt_id;        /* symbol graph index */
+    uint32_t opt_mark;      /* traversal visit mark */
+    chGroup *opt_group;     /* group of a choice and its members */
+    bCond *opt_block;       /* innermost enclosing if/menu block */
 } cEntry; /* config entry */
 
 
@@ -77,34 +118,23 @@ struct cNode
 };
 
 
+/* handle flags and edits, an edit is also the mode of a config file read */
 enum OPTS
 {
-     OUT_VERBOSE = 0x1,
-      OUT_CONFIG = 0x2,
-         OUTMASK = 0x3,
-  DISABLE_CONFIG = 0x4,
-   ENABLE_CONFIG = 0x8,
-   TOGGLE_CONFIG = 0x10,
-        EDITMASK = 0x1F,
-     SHOW_CONFIG = 0x20,
-    CHECK_CONFIG = 0x40,
-     EDIT_CONFIG = 0x80,
-    EDIT_INPLACE = 0x100
+     OUT_VERBOSE = 0x1,     /* CK_VERBOSE */
+  DISABLE_CONFIG = 0x4,     /* CK_DISABLE */
+   ENABLE_CONFIG = 0x8,     /* CK_ENABLE */
+   TOGGLE_CONFIG = 0x10,    /* CK_TOGGLE */
+     SHOW_CONFIG = 0x20,    /* the file is written, see ck_write_config() */
+     EDIT_CONFIG = 0x80,    /* the file is applied, see ck_apply_config() */
+       OUT_QUIET = 0x400
 };
 
 enum INDX
 {
-    IPROG = 0x0,
-    ISOPT = 0x1,
-    IDOPT = 0x2,
-    IEOPT = 0x3,
-    IFOPT = 0x4,
-    ITOPT = 0x5,
-    IARCH = 0x6,
-    IEDTR = 0x7,
-    ITMPD = 0x8,
-    IGREP = 0x9,
-   GSTRSZ = 0xA
+    IARCH = 0x0,
+    ISRCT = 0x1,
+   GSTRSZ = 0x2
 };
 
 enum EXPRTYPE
@@ -114,24 +144,237 @@ enum EXPRTYPE
     EXPR_RANGE = 0x3
 };
 
-extern uint16_t opts;
+typedef enum
+{
+    DIAG_INVALID = 0x1,     /* invalid option value */
+    DIAG_RANGE = 0x2,       /* value out of range */
+    DIAG_DEPENDS = 0x3,     /* option dependency not met */
+    DIAG_MISSING = 0x4,     /* option not in the source tree */
+    DIAG_TOGGLE = 0x5,      /* option can not be toggled */
+    DIAG_CHOICE = 0x6,      /* no choice option enabled */
+    DIAG_SOURCE = 0x7,      /* Kconfig file could not be sourced */
+    DIAG_ERROR = 0x8,       /* operation failed */
+    DIAG_CYCLE = 0x9,       /* select/imply cycle */
+    DIAG_OVERRIDE = 0xA     /* value set again by a later config line */
+} dKind; /* diagnostic kinds */
+
 #define HASHSZ 20000
-extern struct hsearch_data chash;
+#define FNVBASIS 0xcbf29ce484222325ULL
+#define FNVPRIME 0x100000001b3ULL
+
+typedef struct s_index sIndex; /* option text search index, see search.c */
+typedef struct p_index pIndex; /* sorted symbol names, see prefix.c */
+typedef struct c_read cRead;  /* configuration files read, see config.c */
+typedef struct t_walk tWalk;  /* toggle cascade, see engine.c */
+typedef struct l_index lIndex;  /* symbol index of the tree, see locate.c */
+typedef struct m_cache mCache;  /* macro results, see macro.c */
+typedef struct p_fetch pFetch;  /* Kconfig file readers, see prefetch.c */
+
+typedef struct
+{
+    cEntry *t;          /* NULL for a transaction mark */
+    char *value;        /* previous value */
+    int32_t status;     /* previous status, or mark type */
+} jEntry; /* change journal entry */
+
+enum
+{
+    JOPEN = 0x1,        /* mark of an open transaction */
+    JEDIT = 0x2         /* mark of a committed edit: an undo point */
+};
+
+/*
+ * Engine state of a loaded source tree. It is allocated by ck_open(3) and
+ * all engine functions work on the one pointed to by 'ck'; see libconfigk.c
+ */
+typedef struct ck_handle ckHandle;
+struct ck_handle
+{
+    uint32_t c_opts;
+    uint8_t c_postedit;
+    char *c_gstr[GSTRSZ];   /* string options */
+    struct hsearch_data c_chash;
+    cNode *root_node;
+    cNode *curr_node;
+    cNode *curr_root;
+    uint32_t nerrs;
+    char error[256];    /* last error message */
+    jmp_buf fail;       /* return of the API call in progress, see failx() */
+    bool failed;        /* an allocation or parse failure left it unusable */
+    ck_diag_fn diag;
+    void *diag_arg;
+    ck_trace_fn trace;  /* options changed by an edit */
+    void *trace_arg;
+    FILE *cout;         /* config written, see ck_write_config() */
+    int8_t (*cascade)(const char *, uint8_t, char *); /* select/imply hook */
+    void *cascade_arg;  /* state of the hook */
+    uint32_t mark;      /* last traversal mark */
+    jEntry *journal;    /* value changes made in transactions */
+    uint32_t njournal;
+    uint32_t journalsz;
+    uint16_t jdepth;    /* open transactions */
+    sIndex *sindex;     /* built by the first search */
+    pIndex *pindex;     /* built by the first prefix query */
+    bCond *blocks;      /* if/menu block conditions */
+    bCond *cblock;      /* innermost open block while parsing */
+    cRead *cread;
+    tWalk *twalk;
+    lIndex *lindex;     /* only while a tree is read */
+    mCache *mcache;
+    pFetch *prefetch;   /* only while a tree is read */
+    int srcfd;          /* source tree, paths are relative to it */
+    uint32_t vgen;      /* option values generation */
+    bool fprint;        /* fingerprint computed, see fingerprint.c */
+    bool lazy;          /* 'source' lines are skipped, see parse_kconfig() */
+};
+
+extern ckHandle *ck;
+
+/*
+ * Bind 'h' to 'ck' for a call of the API. An allocation or parse failure
+ * in the call, see failx(), returns 'r' from the calling function with the
+ * error set; the handle can only be freed after that.
+ */
+#define CK_ENTER(h, r) \
+    do { \
+        if (ck_bind(h)) \
+            return ck_unbind(r); \
+        if (setjmp((h)->fail)) \
+            return ck_failed(r); \
+    } while (0)
+
+extern int ck_bind(ckHandle *);
+extern int ck_unbind(int);
+extern int ck_failed(int);
+extern void failx(const char *, ...)
+                    __attribute__((noreturn, format(printf, 1, 2)));
+
+#define opts (ck->c_opts)
+#define gstr (ck->c_gstr)
+#define chash (ck->c_chash)
+#define postedit (ck->c_postedit)
 
 extern cNode *tree_root(void);
 extern cNode *tree_curr_root_up(void);
 extern cNode *tree_cnode(void *, nType);
 extern cNode *tree_add(cNode *);
 extern cNode *tree_init(char *);
-extern void tree_display(cNode *);
 extern uint32_t tree_reset(cNode *);
-extern void tree_display_config(cNode *);
+
+typedef enum
+{
+    EDEPENDS = 0x1,
+    ESELECT = 0x2,
+    EIMPLY = 0x4
+} eType; /* symbol graph edge types */
+
+typedef struct
+{
+    uint32_t to;
+    uint8_t type;
+} gEdge; /* symbol graph edge */
+
+typedef struct
+{
+    uint32_t nsym;
+    uint32_t nedge;
+    cNode **sym;        /* opt_id => tree node */
+    uint32_t *out;      /* out[i] .. out[i+1]: edges from symbol i */
+    gEdge *oedge;
+    uint32_t *in;       /* in[i] .. in[i+1]: edges to symbol i */
+    gEdge *iedge;
+} sGraph; /* symbol graph */
+
+#define GNONE UINT32_MAX   /* no symbol or component */
+
+typedef void (*gUndef)(const cNode *, const char *, eType, void *);
+extern sGraph *graph_build(gUndef, void *);
+extern uint32_t graph_scc(const sGraph *, uint8_t, uint32_t *);
+extern void graph_free(sGraph *);
+extern uint32_t graph_mark(void);
+
+struct ch_group
+{
+    cNode *choice;
+    cNode **member;     /* member options in tree order */
+    uint16_t nmember;
+    cNode *active;      /* enabled member, NULL when not known */
+};
+
+extern void choice_build(cNode *);
+extern cNode *choice_active(chGroup *);
+extern cNode *choice_default(const chGroup *, const cNode *);
+extern void choice_invalidate(const cEntry *);
+extern void choice_select(cNode *);
+extern void choice_release(cNode *);
+extern uint32_t choice_free(chGroup *);
+
+typedef struct
+{
+    cNode *c;
+    uint32_t id;        /* tree order */
+    uint32_t score;
+} sHit; /* search result */
+
+extern uint32_t search_configs(const char *, sHit **);
+extern uint32_t search_free(void);
+
+extern char *macro_eval(const char *);
+extern uint32_t macro_free(void);
+
+extern void prefetch_start(const char *);
+extern FILE *prefetch_open(const char *);
+extern const char *prefetch_buf(const char *, size_t *, int64_t *);
+extern char *prefetch_source(const char *, const char *, const char *);
+extern uint32_t prefetch_stop(void);
+
+extern uint64_t fprint_root(void);
+extern void fprint_touch(const cEntry *);
+
+extern int locate_kconfigs(const char *);
+extern int locate_complete(const char *, const char *, ck_name_fn, void *);
+extern void locate_free(void);
+
+extern pIndex *prefix_build(const char *[], uint32_t);
+extern bool prefix_glob(const char *);
+extern uint32_t prefix_match(const char *, cNode ***);
+extern uint32_t prefix_each(const pIndex *, const char *, ck_name_fn, void *);
+extern uint32_t prefix_free(pIndex *);
+
+extern bCond *block_push(char *);
+extern void block_pop(void);
+extern bCond *block_curr(void);
+extern void block_depends(bCond *, char *);
+extern int8_t block_eval(bCond *);
+extern const char *block_failed(const bCond *);
+extern uint32_t block_free(void);
+
+extern void journal_begin(void);
+extern int8_t journal_commit(void);
+extern int8_t journal_rollback(void);
+extern uint32_t journal_undo(uint32_t);
+extern const jEntry *journal_record(cEntry *);
+extern void journal_reset(void);
 
 extern cNode *filenode(cNode *);
 extern char *append(char *, char *);
+extern uint64_t fnv(uint64_t, const void *, size_t);
 extern cEntry *add_new_config(char *, nType);
+extern char *eval_default(const cEntry *);
 extern int8_t check_depends(const char *);
+extern void diagx(dKind, const char *, const char *, ...);
+extern char *gets_range(const char *);
+extern int srcdir_open(const char *);
+extern int read_kconfigs(const char *, const char *);
+extern void parse_kconfig(const char *);
+extern int cache_file(char *, size_t, const char *);
+extern int check_kconfigs(const char *);
+extern uint32_t config_free(void);
+extern uint8_t cache_redits(cEntry *);
+extern void ck_option_fill(ck_option *, const cNode *);
 extern int8_t set_option(const char *, char *);
 extern int8_t validate_option(const char *);
 extern cNode *hsearch_kconfigs(const char *);
 extern int8_t toggle_configs(const char *, uint8_t, char *, bool);
+extern void toggle_trace(const char *);
+extern uint32_t toggle_free(void);
@@ -0,0 +1,288 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include "configk.h"
+#include "report.h"
+
+/*
+ * --graph: structure of the symbol graph, see graph.c. Strongly connected
+ * components are found over all edges, see graph_scc(); those of more than
+ * one symbol, or of one which refers to itself, are cycles.
+ * Tarjan numbers the components sinks first, so the longest chains of
+ * 'depends on' edges are counted in that order in one pass. The graph can
+ * also be written as DOT or as its CSR arrays, see depgraph_bin().
+ */
+
+#define GTOPSZ 10
+
+static const char *etypes[] = { "", "depends", "select", "", "imply" };
+
+static const char *
+gname(const sGraph *g, uint32_t i)
+{
+    return ((cEntry *)g->sym[i]->data)->opt_name;
+}
+
+static void
+depgraph_names(const sGraph *g, const char *kind, const uint32_t *ids,
+                                uint32_t n, uint32_t count, const char *sep)
+{
+    if (ropts & R_JSON)
+    {
+        const char **names = malloc(n * sizeof(char *));
+        if (!names)
+            failx("could not allocate graph names");
+        for (uint32_t i = 0; i < n; i++)
+            names[i] = gname(g, ids[i]);
+        json_graph(kind, count, names, n);
+        free(names);
+        return;
+    }
+
+    printf("  %u:", count);
+    for (uint32_t i = 0; i < n; i++)
+        printf("%s%s", i ? sep : " ", gname(g, ids[i]));
+    putchar('\n');
+
+    return;
+}
+
+static uint32_t
+depgraph_cycles(const sGraph *g, const uint32_t *comp, uint32_t ncomp)
+{
+    uint32_t *size = calloc(ncomp + 1, sizeof(uint32_t));
+    uint32_t *ids = malloc((g->nsym + 1) * sizeof(uint32_t));
+    uint32_t ncycle = 0;
+
+    if (!size || !ids)
+        failx("could not allocate graph cycles");
+    for (uint32_t i = 0; i < g->nsym; i++)
+        size[comp[i]]++;
+    for (uint32_t i = 0; i < g->nsym; i++)
+        for (uint32_t e = g->out[i]; e < g->out[i + 1]; e++)
+            if (g->oedge[e].to == i)
+                size[comp[i]] = size[comp[i]] > 1 ? size[comp[i]] : 2;
+
+    if (!(ropts & R_JSON))
+        printf("Cycles:\n");
+    /* members of a cycle in tree order, the first one tells the cycle */
+    for (uint32_t i = 0; i < g->nsym; i++)
+    {
+        uint32_t c = comp[i], n = 0;
+        if (size[c] < 2)
+            continue;
+
+        for (uint32_t j = i; j < g->nsym; j++)
+            if (comp[j] == c)
+                ids[n++] = j;
+        size[c] = 0;
+        ncycle++;
+        depgraph_names(g, "cycle", ids, n, n, ", ");
+    }
+
+    free(size);
+    free(ids);
+    return ncycle;
+}
+
+static void
+depgraph_chains(const sGraph *g, const uint32_t *comp, uint32_t ncomp)
+{
+    uint32_t n = g->nsym;
+    uint32_t *depth = calloc(n + 1, sizeof(uint32_t));
+    uint32_t *next = malloc((n + 1) * sizeof(uint32_t));
+    uint32_t *order = malloc((n + 1) * sizeof(uint32_t));
+    uint32_t *cnt = calloc(ncomp + 1, sizeof(uint32_t));
+    if (!depth || !next || !order || !cnt)
+        failx("could not allocate graph chains");
+
+    /* symbols by component: an edge leads to a component counted before */
+    for (uint32_t i = 0; i < n; i++)
+        cnt[comp[i] + 1]++;
+    for (uint32_t c = 1; c <= ncomp; c++)
+        cnt[c] += cnt[c - 1];
+    for (uint32_t i = 0; i < n; i++)
+        order[cnt[comp[i]]++] = i;
+
+    for (uint32_t k = 0; k < n; k++)
+    {
+        uint32_t v = order[k];
+        depth[v] = 1;
+        next[v] = GNONE;
+        for (uint32_t e = g->out[v]; e < g->out[v + 1]; e++)
+        {
+            uint32_t w = g->oedge[e].to;
+            if (EDEPENDS != g->oedge[e].type || comp[w] == comp[v]
+                || depth[w] + 1 <= depth[v])
+                continue;
+            depth[v] = depth[w] + 1;
+            next[v] = w;
+        }
+    }
+
+    if (!(ropts & R_JSON))
+        printf("Longest dependency chains:\n");
+    uint32_t mark = graph_mark();
+    for (uint32_t t = 0; t < GTOPSZ / 2; t++)
+    {
+        uint32_t best = GNONE;
+        for (uint32_t i = 0; i < n; i++)
+            if (((cEntry *)g->sym[i]->data)->opt_mark != mark
+                && (GNONE == best || depth[i] > depth[best]))
+                best = i;
+        if (GNONE == best || depth[best] < 2)
+            break;
+
+        uint32_t m = 0;
+        for (uint32_t v = best; GNONE != v; v = next[v])
+        {
+            ((cEntry *)g->sym[v]->data)->opt_mark = mark;
+            order[m++] = v;
+        }
+        depgraph_names(g, "chain", order, m, m, " -> ");
+    }
+
+    free(depth);
+    free(next);
+    free(order);
+    free(cnt);
+    return;
+}
+
+/* symbols with the most edges, to them (in) or from them */
+static void
+depgraph_fan(const sGraph *g, const uint32_t *off, bool in)
+{
+    uint32_t top[GTOPSZ], ntop = 0;
+
+    for (uint32_t i = 0; i < g->nsym; i++)
+    {
+        uint32_t d = off[i + 1] - off[i], k;
+        if (!d || (GTOPSZ == ntop && d <= off[top[ntop - 1] + 1]
+                                                - off[top[ntop - 1]]))
+            continue;
+
+        k = ntop < GTOPSZ ? ntop++ : GTOPSZ - 1;
+        while (k && d > off[top[k - 1] + 1] - off[top[k - 1]])
+        {
+            top[k] = top[k - 1];
+            k--;
+        }
+        top[k] = i;
+    }
+
+    if (!(ropts & R_JSON))
+        printf("Highest fan-%s:\n", in ? "in" : "out");
+    for (uint32_t k = 0; k < ntop; k++)
+        depgraph_names(g, in ? "fan-in" : "fan-out", &top[k], 1,
+                                        off[top[k] + 1] - off[top[k]], "");
+
+    return;
+}
+
+static void
+depgraph_dot(const sGraph *g)
+{
+    printf("digraph kconfig {\n");
+    for (uint32_t i = 0; i < g->nsym; i++)
+        for (uint32_t e = g->out[i]; e < g->out[i + 1]; e++)
+        {
+            uint8_t t = g->oedge[e].type;
+            printf("  \"%s\" -> \"%s\"%s;\n", gname(g, i),
+                gname(g, g->oedge[e].to), ESELECT == t ? " [color=blue]"
+                : EIMPLY == t ? " [style=dashed]" : "");
+        }
+    printf("}\n");
+
+    return;
+}
+
+/*
+ * Binary edge list, in host byte order: "CKG1", the number of symbols and
+ * of edges as uint32, symbol names NUL terminated in tree order, nsym + 1
+ * uint32 offsets: edges of symbol i are from off[i] to off[i + 1], nedge
+ * uint32 target symbols and nedge uint8 edge types: 1 depends, 2 select,
+ * 4 imply.
+ */
+static void
+depgraph_bin(const sGraph *g)
+{
+    if (isatty(STDOUT_FILENO))
+    {
+        diagx(DIAG_ERROR, NULL, "will not write a binary graph to a terminal");
+        return;
+    }
+
+    fwrite("CKG1", 1, 4, stdout);
+    fwrite(&g->nsym, sizeof(uint32_t), 1, stdout);
+    fwrite(&g->nedge, sizeof(uint32_t), 1, stdout);
+    for (uint32_t i = 0; i < g->nsym; i++)
+        fwrite(gname(g, i), 1, strlen(gname(g, i)) + 1, stdout);
+    fwrite(g->out, sizeof(uint32_t), g->nsym + 1, stdout);
+    for (uint32_t e = 0; e < g->nedge; e++)
+        fwrite(&g->oedge[e].to, sizeof(uint32_t), 1, stdout);
+    for (uint32_t e = 0; e < g->nedge; e++)
+        fwrite(&g->oedge[e].type, sizeof(uint8_t), 1, stdout);
+    fflush(stdout);
+
+    return;
+}
+
+/*
+ * Analyse the symbol graph, or write it in 'fmt': "dot" or "bin". Returns
+ * the number of cycles found.
+ */
+int
+depgraph_kconfigs(ck_handle *h, const char *fmt)
+{
+    CK_ENTER(h, -1);
+    uint32_t nerrs = h->nerrs;
+    uint32_t r = 0, ntype[5] = { 0 };
+    sGraph *g = graph_build(NULL, NULL);
+
+    if (fmt && !strcmp(fmt, "dot"))
+        depgraph_dot(g);
+    else if (fmt && !strcmp(fmt, "bin"))
+        depgraph_bin(g);
+    else if (fmt)
+        diagx(DIAG_ERROR, NULL, "invalid --graph format: '%s'", fmt);
+    else
+    {
+        for (uint32_t e = 0; e < g->nedge; e++)
+            ntype[g->oedge[e].type]++;
+        if (!(ropts & R_JSON))
+            printf("Symbols: %u, edges: %u (%s %u, %s %u, %s %u)\n",
+                    g->nsym, g->nedge, etypes[EDEPENDS], ntype[EDEPENDS],
+                    etypes[ESELECT], ntype[ESELECT],
+                    etypes[EIMPLY], ntype[EIMPLY]);
+
+        uint32_t *comp = malloc((g->nsym + 1) * sizeof(uint32_t));
+        if (!comp)
+            failx("could not allocate graph components");
+
+        uint32_t ncomp = graph_scc(g, EDEPENDS|ESELECT|EIMPLY, comp);
+        r = depgraph_cycles(g, comp, ncomp);
+        depgraph_chains(g, comp, ncomp);
+        depgraph_fan(g, g->in, true);
+        depgraph_fan(g, g->out, false);
+        free(comp);
+    }
+
+    graph_free(g);
+    return ck_unbind(nerrs != h->nerrs ? -1 : (int)r);
+}
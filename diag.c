@@ -0,0 +1,213 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <libgen.h>
+#include "configk.h"
+#include "report.h"
+
+/*
+ * Diagnostics collector: diag_report() is the diagnostic callback of the
+ * configk handles. Warnings are kept by kind and message, each one once
+ * with the number of times it was reported, instead of being written as
+ * they come. diag_flush() writes them in one batch, grouped by kind, or
+ * only the counts of each kind with --summary. Errors are not reported to
+ * the callback, configk shows ck_error() at once.
+ */
+
+typedef struct
+{
+    char *key;          /* kind, then the message */
+    uint32_t count;
+} dEntry;
+
+typedef struct
+{
+    dEntry *ent;        /* in the order they are first reported */
+    uint32_t nent;
+    uint32_t entsz;
+    uint32_t nkind[DIAG_OVERRIDE + 1];
+    struct hsearch_data h;  /* key => entry index + 1 */
+} dLog; /* diagnostics log */
+
+static dLog *dlog = NULL;
+extern const char *dkinds[];
+
+/* collect warnings until diag_flush() */
+void
+diag_start(void)
+{
+    if (dlog)
+        return;
+
+    dlog = calloc(1, sizeof(dLog));
+    if (!dlog || !hcreate_r(HASHSZ, &dlog->h))
+        err(-1, "could not create diagnostics log");
+
+    return;
+}
+
+static void
+diag_reset(dLog *d)
+{
+    for (uint32_t i = 0; i < d->nent; i++)
+        free(d->ent[i].key);
+    free(d->ent);
+    hdestroy_r(&d->h);
+
+    d->ent = NULL;
+    d->nent = d->entsz = 0;
+    memset(d->nkind, 0, sizeof(d->nkind));
+    return;
+}
+
+/* add a warning, returns 0 if it was not collected */
+static int8_t
+diag_add(dKind kind, const char *msg)
+{
+    dLog *d = dlog;
+    ENTRY e, *r;
+    size_t n = strlen(msg);
+
+    char *key = malloc(n + 2);
+    if (!key)
+        return 0;
+    key[0] = '0' + kind;
+    memcpy(key + 1, msg, n + 1);
+
+    e.key = key;
+    if (hsearch_r(e, FIND, &r, &d->h) && r)
+    {
+        d->ent[(uintptr_t)r->data - 1].count++;
+        d->nkind[kind]++;
+        free(key);
+        return 1;
+    }
+
+    if (d->nent == d->entsz)
+    {
+        dEntry *t = realloc(d->ent,
+                        (d->entsz ? d->entsz * 2 : 256) * sizeof(dEntry));
+        if (!t)
+        {
+            free(key);
+            return 0;
+        }
+        d->ent = t;
+        d->entsz = d->entsz ? d->entsz * 2 : 256;
+    }
+
+    /* the table is full: the message is shown as it comes */
+    e.data = (void *)(uintptr_t)(d->nent + 1);
+    if (!hsearch_r(e, ENTER, &r, &d->h))
+    {
+        free(key);
+        return 0;
+    }
+    d->ent[d->nent++] = (dEntry){ key, 1 };
+    d->nkind[kind]++;
+
+    return 1;
+}
+
+void
+diag_report(const char *kind, const char *opt, const char *msg, void *arg)
+{
+    (void)arg;
+    uint8_t k = DIAG_INVALID;
+
+    if (ropts & R_JSON)
+    {
+        json_diag(kind, opt, msg);
+        return;
+    }
+
+    while (k < DIAG_OVERRIDE && strcmp(dkinds[k], kind))
+        k++;
+    if (!dlog || !diag_add(k, msg))
+        warnx("%s", msg);
+
+    return;
+}
+
+/* write the collected warnings to stderr, then empty the log */
+void
+diag_flush(void)
+{
+    dLog *d = dlog;
+    char *buf = NULL;
+    size_t len = 0;
+
+    if (!d || !d->nent)
+        return;
+
+    FILE *out = open_memstream(&buf, &len);
+    if (!out)
+        err(-1, "could not write diagnostics");
+
+    /* as warnx(3) shows them */
+    const char *prog = rprog ? basename((char *)rprog) : "configk";
+    uint32_t total = 0;
+    for (uint8_t k = DIAG_INVALID; k <= DIAG_OVERRIDE; k++)
+    {
+        total += d->nkind[k];
+        for (uint32_t i = 0; !(ropts & R_SUMMARY) && i < d->nent; i++)
+        {
+            dEntry *t = &d->ent[i];
+            if (t->key[0] != '0' + k)
+                continue;
+
+            fprintf(out, "%s: %s", prog, t->key + 1);
+            if (t->count > 1)
+                fprintf(out, " (%u times)", t->count);
+            fputc('\n', out);
+        }
+    }
+
+    fprintf(out, "Warnings: %u, %u unique;", total, d->nent);
+    const char *sep = " ";
+    for (uint8_t k = DIAG_INVALID; k <= DIAG_OVERRIDE; k++)
+        if (d->nkind[k])
+        {
+            fprintf(out, "%s%s %u", sep, dkinds[k], d->nkind[k]);
+            sep = ", ";
+        }
+    fputc('\n', out);
+    fclose(out);
+
+    fflush(stdout);
+    fwrite(buf, 1, len, stderr);
+    free(buf);
+
+    diag_reset(d);
+    if (!hcreate_r(HASHSZ, &d->h))
+        err(-1, "could not create diagnostics log");
+
+    return;
+}
+
+void
+diag_free(void)
+{
+    if (!dlog)
+        return;
+
+    diag_reset(dlog);
+    free(dlog);
+    dlog = NULL;
+
+    return;
+}
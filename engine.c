@@ -0,0 +1,781 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "configk.h"
+#include "parser.tab.h"
+#include "eparse.tab.h"
+
+extern int yyparse(void);
+extern void yyrestart(FILE *);
+extern int yylineno;
+extern uint16_t chcount;
+extern int8_t eescans(uint8_t, const char *, char **);
+
+ckHandle *ck = NULL; /* engine state of the tree in use */
+const char *types[] = { "", "int", "hex", "bool", "string", "tristate" };
+const char *dkinds[] = \
+    { "", "invalid", "range", "depends", "missing", "toggle", "choice",
+      "source", "error", "cycle", "override" };
+
+cNode *
+filenode(cNode *c)
+{
+    while (c->type != SENTRY)
+        c = c->up;
+    return c;
+}
+
+char *
+append(char *dst, char *src)
+{
+#define CDLM    ";\n\t" /* delimiter for select/depends list */
+    char *tmp = NULL;
+    uint16_t slen = strlen(src);
+    uint16_t dlen = dst ? strlen(dst) + 4 : 1;
+
+    tmp = calloc(slen + dlen, sizeof(char));
+    if (tmp && dst)
+    {
+        strcpy(tmp, dst);
+        strncat(tmp, CDLM, 4);
+        free(dst);
+    }
+    else if (!tmp)
+        failx("could not allocate memory for: '%s'", src);
+
+    return strncat(tmp, src, slen);
+}
+
+/* FNV-1a hash of 'n' bytes, continued from 'h' */
+uint64_t
+fnv(uint64_t h, const void *p, size_t n)
+{
+    const uint8_t *b = p;
+
+    while (n--)
+        h = (h ^ *b++) * FNVPRIME;
+
+    return h;
+}
+
+/* path of a file in the configk cache directory, created if needed */
+int
+cache_file(char *path, size_t sz, const char *name)
+{
+    char dir[1024];
+    const char *cdir = getenv("XDG_CACHE_HOME");
+
+    if (cdir)
+        snprintf(dir, sizeof(dir), "%s", cdir);
+    else if (getenv("HOME"))
+        snprintf(dir, sizeof(dir), "%s/.cache", getenv("HOME"));
+    else
+        return -1;
+    mkdir(dir, 0755);
+    strncat(dir, "/configk", sizeof(dir) - strlen(dir) - 1);
+    mkdir(dir, 0755);
+    snprintf(path, sz, "%s/%s", dir, name);
+
+    return 0;
+}
+
+cEntry *
+add_new_config(char *cid, nType ctype)
+{
+    ENTRY e, *r;
+    cEntry *t = NULL;
+
+    e.key = cid;
+    if (hsearch_r(e, FIND, &r, &chash))
+    {
+        if (opts & OUT_VERBOSE)
+            warnx("'%s' read again, use earlier object", r->key);
+        t = ((cNode *)r->data)->data;
+        if (!t)
+            failx("'%s' data object is %p", r->key, (void *)t);
+        t->opt_ndef++;
+        t->opt_dfile = ((sEntry *)filenode(ck->curr_root)->data)->fname;
+        free(cid);
+        return t;
+    }
+
+    t = calloc(1, sizeof(cEntry));
+    if (!t)
+        failx("could not allocate option '%s'", cid);
+    t->opt_name = cid;
+    t->opt_ndef = 1;
+
+    e.data = tree_add(tree_cnode(t, ctype));
+    if (!hsearch_r(e, ENTER, &r, &chash))
+        diagx(DIAG_ERROR, cid, "could not hash option '%s'", e.key);
+
+    return t;
+}
+
+/* parse one Kconfig file without the files it sources, see locate.c */
+void
+parse_kconfig(const char *fname)
+{
+    ENTRY e, *r;
+
+    e.key = (char *)fname;
+    if (hsearch_r(e, FIND, &r, &chash))
+        return;
+
+    FILE *fin = prefetch_open(fname);
+    if (!fin)
+    {
+        diagx(DIAG_SOURCE, NULL,
+                "could not source file: %s: %s", fname, strerror(errno));
+        return;
+    }
+
+    sEntry *s = calloc(1, sizeof(sEntry));
+    if (!s || !(s->fname = e.key = strdup(fname)))
+        failx("could not allocate file '%s'", fname);
+    e.data = tree_add(tree_cnode(s, SENTRY));
+    if (!hsearch_r(e, ENTER, &r, &chash))
+        diagx(DIAG_ERROR, NULL, "could not hash file '%s'", e.key);
+
+    ck->lazy = true;
+    yyrestart(fin);
+    yylineno = 1;
+    if (yyparse())
+        failx("could not parse file: %s", fname);
+    ck->lazy = false;
+
+    fclose(fin);
+    tree_curr_root_up();
+    return;
+}
+
+/*
+ * Open 'srcdir' as the tree of the handle: Kconfig files are opened
+ * relative to 'srcfd', the cwd of the process is not changed.
+ */
+int
+srcdir_open(const char *srcdir)
+{
+    char *path = NULL;
+    int fd = open(srcdir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+
+    if (fd < 0 || !(path = realpath(srcdir, NULL)))
+    {
+        diagx(DIAG_ERROR, NULL,
+                "could not open directory: %s: %s", srcdir, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    if (ck->srcfd >= 0)
+        close(ck->srcfd);
+    ck->srcfd = fd;
+    free(gstr[ISRCT]);
+    gstr[ISRCT] = path;
+
+    return 0;
+}
+
+/* parse the tree of 'srcdir', or with 'sym' only files it needs */
+int
+read_kconfigs(const char *srcdir, const char *sym)
+{
+    int r = -1;
+    CK_PROBE(read_entry, srcdir, sym);
+    if (srcdir_open(srcdir))
+        goto ext;
+
+    chcount = 0;
+
+    if (sym)
+    {
+        tree_init("Kconfig");
+        if (!(r = locate_kconfigs(sym)))
+            choice_build(ck->root_node);
+        goto ext;
+    }
+
+    prefetch_start("Kconfig");
+    FILE *fin = prefetch_open("Kconfig");
+    if (!fin)
+    {
+        diagx(DIAG_ERROR, NULL, "could not open file: %s/%s: %s",
+                                    srcdir, "Kconfig", strerror(errno));
+        prefetch_stop();
+        goto ext;
+    }
+
+    yyrestart(fin);
+    tree_init("Kconfig");
+
+    if (yyparse())
+        failx("could not parse file: %s/%s", srcdir, "Kconfig");
+    fclose(fin);
+    prefetch_stop();
+    choice_build(ck->root_node);
+    r = 0;
+ext:
+    /* blocks an unbalanced or aborted file left open end with the tree */
+    ck->cblock = NULL;
+    CK_PROBE(read_return, srcdir, r);
+    return r;
+}
+
+cNode *
+hsearch_kconfigs(const char *copt)
+{
+    ENTRY e, *r;
+
+    e.data = NULL;
+    e.key = (char *)copt;
+    if (!hsearch_r(e, FIND, &r, &chash))
+    {
+        CK_PROBE(hsearch, copt, 0);
+        return NULL;
+    }
+
+    CK_PROBE(hsearch, copt, 1);
+    return (cNode *)r->data;
+}
+
+char *
+gets_range(const char *exp)
+{
+    char *rxp, *txp, *tok, *svp;
+
+    rxp = NULL;
+    txp = strdup(exp);
+    tok = strtok_r(txp, CDLM, &svp);
+    while (tok)
+    {
+        uint8_t l = (rxp ? strlen(rxp) : 0) + strlen(tok) + 8;
+        char *t = calloc(l, sizeof(uint8_t));
+
+        if (rxp)
+        {
+            snprintf(t, l, "%.200s;range %s", rxp, tok);
+            free(rxp);
+        }
+        else
+            snprintf(t, l, "range %s", tok);
+
+        rxp = t;
+        tok = strtok_r(NULL, CDLM, &svp);
+    }
+    free(txp);
+
+    char *rng = calloc(64, sizeof(uint8_t));
+    eescans(EXPR_RANGE, rxp, &rng);
+    //int8_t r =
+    //warnx("%s: %s(%d): %d=>%s", __func__, rxp, strlen(rxp), r, rng);
+
+    free(rxp);
+    return rng;
+}
+
+static uint8_t
+validate_range(long val, const char *rexp)
+{
+    long r1, r2;
+    char *range = gets_range(rexp);
+
+    sscanf(range, "%li %li", &r1, &r2);
+    free(range);
+
+    return (r1 <= val && val <= r2);
+}
+
+int8_t
+validate_option(const char *opt)
+{
+    char *val;
+    int8_t l, rangerr = 17;
+
+    cNode *c = hsearch_kconfigs(opt);
+    cEntry *t = (cEntry *)c->data;
+
+    val = t->opt_value;
+    t->opt_status = t->opt_type;
+    switch (t->opt_type)
+    {
+    case CINT:
+        long v = atoi(val);
+        if (*val != '0' && !v)
+            t->opt_status = -t->opt_type;
+        else if (t->opt_range && !validate_range(v, t->opt_range))
+            t->opt_status = -rangerr;
+        break;
+
+    case CBOOL:
+        l = strlen(val);
+        if (l > 1 || !strstr("yYnN", val))
+            t->opt_status = -t->opt_type;
+        else if ('n' == *val || 'N' == *val)
+            t->opt_status = -CVALNOSET;
+        break;
+
+    case CTRISTATE:
+        l = strlen(val);
+        if (l > 1 || !strstr("yYnNmM", val))
+            t->opt_status = -t->opt_type;
+        else if ('n' == *val || 'N' == *val)
+            t->opt_status = -CVALNOSET;
+        break;
+
+    case CHEX:
+        l = strlen(val);
+        if (l > 18 || val[0] != '0' || (val[1] != 'x' && val[1] != 'X'))
+            t->opt_status = -t->opt_type;
+        if (t->opt_status > 0)
+        {
+            char *c = val + 2;
+            while (*c && isxdigit(*c)) c++;
+            if (*c)
+                t->opt_status = -t->opt_type;
+        }
+        if (t->opt_status > 0 && t->opt_range)
+        {
+            long v = strtol(val, NULL, 0);
+            if (!validate_range(v, t->opt_range))
+                t->opt_status = -rangerr;
+        }
+        break;
+
+    default: ;
+    }
+    if ((int8_t)-t->opt_type == t->opt_status)
+        diagx(DIAG_INVALID, opt, "option '%s' has invalid %s value: '%s'",
+                                        opt, types[t->opt_type], val);
+    if (-rangerr == t->opt_status)
+    {
+        diagx(DIAG_RANGE, opt,
+                    "option '%s' has out of range value: '%s'", opt, val);
+        t->opt_status = -t->opt_type;
+    }
+
+    CK_PROBE(validate, opt, t->opt_status);
+    return t->opt_status;
+}
+
+int8_t
+set_option(const char *opt, char *val)
+{
+    cNode *c = hsearch_kconfigs(opt);
+    if (!c)
+        return 0;
+
+    cEntry *t = (cEntry *)c->data;
+    journal_record(t);
+    if (val)
+        val = strdup(val);
+    else if (t->opt_value)
+    {
+        val = strdup("n");
+        if (!eescans(EXPR_DEFAULT, t->opt_value, &val))
+        {
+            free(val);
+            val = NULL;
+        }
+    }
+    if (val)
+    {
+        /* the first value replaces the 'default' attribute, keep it */
+        if (!t->opt_default)
+            t->opt_default = t->opt_value;
+        else
+            free(t->opt_value);
+        t->opt_value = val;
+    }
+    if (!strcmp(t->opt_value, "is not set"))
+        return t->opt_status = -CVALNOSET;
+
+    ((sEntry *)filenode(c)->data)->u_count++;
+    return validate_option(opt);
+}
+
+/* value of the 'default' attribute, or NULL if none applies */
+char *
+eval_default(const cEntry *t)
+{
+    const char *d = t->opt_default ? t->opt_default : t->opt_value;
+    char *val = strdup("n");
+
+    if (!d || !eescans(EXPR_DEFAULT, d, &val))
+    {
+        free(val);
+        return NULL;
+    }
+
+    return val;
+}
+
+int8_t
+check_depends(const char *sopt)
+{
+    int8_t r = -1;
+    cNode *c = hsearch_kconfigs(sopt);
+    cEntry *t = (cEntry *)c->data;
+
+    /* conditions of enclosing if/menu blocks are shared, see block.c */
+    int8_t b = block_eval(t->opt_block);
+    if (!t->opt_depends || !b)
+        return b;
+
+    if (opts & OUT_VERBOSE)
+        fprintf(stderr, "%s depends on %s: ", t->opt_name, t->opt_depends);
+    r = eescans(EXPR_DEPENDS, t->opt_depends, NULL);
+    if (opts & OUT_VERBOSE)
+        fprintf(stderr, ":=> %d\n", r);
+
+    return (b > 0 && b < r) ? b : r;
+}
+
+/*
+ * An error is kept for ck_error() and returned by the call in progress, a
+ * warning is passed to the diagnostic callback, or written to stderr.
+ */
+void
+diagx(dKind kind, const char *opt, const char *format, ...)
+{
+    char msg[sizeof(ck->error)];
+    va_list ap;
+
+    if (DIAG_ERROR != kind && !ck->diag && (opts & OUT_QUIET))
+        return;
+
+    va_start(ap, format);
+    vsnprintf(msg, sizeof(msg), format, ap);
+    va_end(ap);
+
+    if (DIAG_ERROR == kind)
+    {
+        ck->nerrs++;
+        strcpy(ck->error, msg);
+    }
+    else if (ck->diag)
+        ck->diag(dkinds[kind], opt, msg, ck->diag_arg);
+    else
+        warnx("%s", msg);
+
+    return;
+}
+
+/*
+ * An allocation or parse failure: the tree in use may be half built, so
+ * the call of the API in progress returns with 'format' as its error and
+ * the handle is left to be freed, see CK_ENTER().
+ */
+void
+failx(const char *format, ...)
+{
+    va_list ap;
+
+    va_start(ap, format);
+    vsnprintf(ck->error, sizeof(ck->error), format, ap);
+    va_end(ap);
+
+    ck->nerrs++;
+    ck->failed = true;
+    longjmp(ck->fail, 1);
+}
+
+/*
+ * Enable, disable and toggle cascade: options reached through select/imply
+ * and choice groups are pushed on a worklist and handled in the depth first
+ * order of the attributes, each one once per cascade. An option reached
+ * again while on the path of the one reaching it is a cycle, it is reported
+ * and not followed.
+ */
+
+typedef struct
+{
+    cNode *c;
+    uint8_t status;
+    uint16_t depth;
+    char *val;
+    const char *head;   /* traced with the option */
+} tWork; /* pending toggle */
+
+struct t_walk
+{
+    tWork *work;
+    uint32_t nwork;
+    uint32_t worksz;
+    cNode **path;       /* options from the first one to the current one */
+    uint16_t npath;
+    uint16_t pathsz;
+    uint16_t depth;     /* of options pushed now */
+    const char *head;
+    uint32_t mark;
+    bool on;
+}; /* kept in the handle with its buffers, see toggle_free() */
+
+#define tw (*ck->twalk)
+
+static void
+toggle_walk(void)
+{
+    if (!ck->twalk && !(ck->twalk = calloc(1, sizeof(tWalk))))
+        failx("could not allocate toggle cascade");
+    return;
+}
+
+uint32_t
+toggle_free(void)
+{
+    uint32_t tmem = 0;
+
+    if (!ck->twalk)
+        return tmem;
+
+    tmem = tw.worksz * sizeof(tWork) + tw.pathsz * sizeof(cNode *);
+    free(tw.work);
+    free(tw.path);
+    free(ck->twalk);
+    ck->twalk = NULL;
+
+    return tmem;
+}
+
+/* trace 'msg' with the next option pushed on the cascade */
+void
+toggle_trace(const char *msg)
+{
+    toggle_walk();
+    tw.head = msg;
+    return;
+}
+
+static void
+toggle_cycle(const cNode *c)
+{
+    char msg[1024];
+    uint16_t i = 0, n = 0;
+
+    while (i < tw.npath && tw.path[i] != c)
+        i++;
+    if (i == tw.npath)
+        return;
+
+    for (; i < tw.npath && n < sizeof(msg) - 1; i++)
+        n += snprintf(msg + n, sizeof(msg) - n, "%s -> ",
+                                ((cEntry *)tw.path[i]->data)->opt_name);
+    snprintf(msg + (n < sizeof(msg) ? n : sizeof(msg) - 1),
+                sizeof(msg) - (n < sizeof(msg) ? n : sizeof(msg) - 1),
+                "%s", ((cEntry *)c->data)->opt_name);
+    diagx(DIAG_CYCLE, ((cEntry *)c->data)->opt_name, "select cycle: %s", msg);
+
+    return;
+}
+
+static void
+toggle_push(cNode *c, uint8_t status, const char *val)
+{
+    const char *head = tw.head;
+
+    tw.head = NULL;
+    if (((cEntry *)c->data)->opt_mark == tw.mark)
+    {
+        toggle_cycle(c);
+        return;
+    }
+
+    if (tw.nwork == tw.worksz)
+    {
+        tw.worksz = tw.worksz ? tw.worksz * 2 : 256;
+        if (!(tw.work = realloc(tw.work, tw.worksz * sizeof(tWork))))
+            failx("could not allocate toggle worklist");
+    }
+    tw.work[tw.nwork++] = (tWork){ c, status, tw.depth,
+                                    val ? strdup(val) : NULL, head };
+
+    return;
+}
+
+static int8_t
+toggle_cascade(const char *sopt, uint8_t status, char *val)
+{
+    cNode *c = hsearch_kconfigs(sopt);
+    if (!c)
+    {
+        diagx(DIAG_MISSING, sopt, "'%s' not found in the options' list", sopt);
+        return 0;
+    }
+
+    toggle_push(c, status, val);
+    return 1;
+}
+
+/* change the value of one option, returns 0 if it can not be changed */
+static int8_t
+toggle_option(cEntry *t, uint8_t status, char *val)
+{
+    if (ENABLE_CONFIG == status)
+        set_option(t->opt_name, val);
+    if (TOGGLE_CONFIG == status)
+    {
+        if (t->opt_status && CTRISTATE == t->opt_type)
+        {
+            journal_record(t);
+            if ('y' == tolower(*t->opt_value))
+                *t->opt_value = 'm';
+            else if ('m' == tolower(*t->opt_value))
+                *t->opt_value = 'y';
+        }
+        else
+        {
+            diagx(DIAG_TOGGLE, t->opt_name,
+                "option '%s' is disabled or is not tristate, skip toggle",
+                t->opt_name);
+            return 0;
+        }
+    }
+    if (DISABLE_CONFIG == status)
+    {
+        journal_record(t);
+        t->opt_status = -CVALNOSET;
+    }
+
+    return 1;
+}
+
+/* toggle an option, push the ones it selects, implies or excludes */
+static int8_t
+toggle_expand(tWork *w)
+{
+    cNode *c = w->c;
+    cEntry *t = c->data;
+
+    if (!toggle_option(t, w->status, w->val))
+        return 0;
+    CK_PROBE(toggle, t->opt_name, w->depth + 1, w->status, t->opt_status);
+
+    if (t->opt_status && t->opt_status != -CVALNOSET
+        && !check_depends(t->opt_name))
+        diagx(DIAG_DEPENDS, t->opt_name,
+                    "option dependency not met for '%s'", t->opt_name);
+
+    if (ck->trace)
+    {
+        ck_option o;
+        ck_option_fill(&o, c);
+        ck->trace(&o, w->status, w->depth + 1, w->head, ck->trace_arg);
+    }
+    if (postedit)
+        cache_redits(t);
+
+    /* pushed in reverse, to be handled in the order of the attributes */
+    uint32_t first = tw.nwork;
+    tw.depth = w->depth + 1;
+    if (t->opt_select)
+        eescans(w->status, t->opt_select, &w->val);
+    if (t->opt_imply)
+        eescans(w->status, t->opt_imply, &w->val);
+
+    /* boolean choice: enable one and disable others */
+    if (c->type == CENTRY && t->opt_group && t->opt_type == CBOOL)
+    {
+        if (ENABLE_CONFIG == w->status && t->opt_status > 0)
+            choice_select(c);
+        if (DISABLE_CONFIG == w->status && t->opt_status < 0)
+            choice_release(c);
+    }
+    for (uint32_t i = first, j = tw.nwork; i + 1 < j; i++, j--)
+    {
+        tWork x = tw.work[i];
+        tw.work[i] = tw.work[j - 1];
+        tw.work[j - 1] = x;
+    }
+
+    return 1;
+}
+
+int8_t
+toggle_configs(const char *sopt, uint8_t status, char *val, bool recursive)
+{
+    cNode *c = hsearch_kconfigs(sopt);
+    if (!c)
+    {
+        diagx(DIAG_MISSING, sopt, "'%s' not found in the options' list", sopt);
+        return 0;
+    }
+
+    cEntry *t = (cEntry *)c->data;
+    if (!recursive)
+    {
+        if (!toggle_option(t, status, val))
+            return 0;
+        CK_PROBE(toggle, t->opt_name, 0, status, t->opt_status);
+        choice_invalidate(t);
+        return 1;
+    }
+
+    /* called by choice_select() or choice_release() in a cascade */
+    toggle_walk();
+    if (tw.on)
+    {
+        toggle_push(c, status, val);
+        return 1;
+    }
+
+    int8_t r = 1;
+    int8_t (*cascade)(const char *, uint8_t, char *) = ck->cascade;
+    tw.on = true;
+    tw.mark = graph_mark();
+    tw.nwork = tw.npath = tw.depth = 0;
+    ck->cascade = toggle_cascade;
+
+    toggle_push(c, status, val);
+    while (tw.nwork)
+    {
+        tWork w = tw.work[--tw.nwork];
+        cEntry *wt = w.c->data;
+        if (wt->opt_mark == tw.mark)
+        {
+            free(w.val);
+            continue;
+        }
+
+        if (w.depth >= tw.pathsz)
+        {
+            tw.pathsz = tw.pathsz ? tw.pathsz * 2 : 64;
+            if (!(tw.path = realloc(tw.path, tw.pathsz * sizeof(cNode *))))
+                failx("could not allocate toggle path");
+        }
+        tw.path[w.depth] = w.c;
+        tw.npath = w.depth + 1;
+        wt->opt_mark = tw.mark;
+
+        int8_t e = toggle_expand(&w);
+        if (w.c == c)
+            r = e;
+        free(w.val);
+    }
+
+    ck->cascade = cascade;
+    tw.on = false;
+    tw.head = NULL;
+    return r;
+}
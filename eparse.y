@@ -48,12 +48,12 @@
 #include "configk.h"
 
 static int8_t is_enabled(const char *);
+static int8_t macro_value(char *, char **);
 static cEntry *get_centry(const char *);
 int8_t eval_expression(uint8_t, const char *, char **);
 void yyerror(YYLTYPE *, uint8_t, char **, char const *);
 
 uint8_t ifctx = 0;
-extern char *gstr;
 extern char *types[];
 extern int yylex(YYSTYPE *, YYLTYPE *);
 %}
@@ -257,15 +257,22 @@ expr:
     | expr EE_AND expr { $$ = ($1 && $3); }
     | EE_BM expr EE_EM { $$ = $2; }
     | EE_BM macroexpr EE_EM {
-        $$=0;
+        char *m = macro_eval($2);
         if (opts & OUT_VERBOSE)
-            fprintf(stderr, "$(%s)\n", $2);
+            fprintf(stderr, "$(%s)(%s) ", $2, m);
+        $$ = macro_value(m, val);
         free($2);
     }
     | EE_BM macroexpr EE_EM EE_IF { ifctx=1; } expr {
-        $$=0;
-        if (opts & OUT_VERBOSE)
-            fprintf(stderr, "$(%s) if %d\n", $2, $6);
+        ifctx = 0;
+        $$ = $6;
+        if ($$)
+        {
+            char *m = macro_eval($2);
+            if (opts & OUT_VERBOSE)
+                fprintf(stderr, "$(%s)(%s) if %d ", $2, m, $6);
+            $$ = macro_value(m, val);
+        }
         free($2);
     }
     | EE_RANGE rangexpr {
@@ -369,7 +376,8 @@ rangexpr:
 void
 yyerror(YYLTYPE *loc, uint8_t etype, char **val, char const *serr)
 {
-    warnx("%s => %d:%d: %s:%s", __func__, loc->last_line, etype, *val, serr);
+    diagx(DIAG_INVALID, NULL, "%s => %d:%d: %s:%s",
+                        __func__, loc->last_line, etype, val ? *val : "", serr);
 }
 
 static cEntry *
@@ -406,6 +414,28 @@ is_enabled(const char *sopt)
     return t->opt_status;
 }
 
+/* a macro result is a value where one is wanted, else a y/m/n condition */
+static int8_t
+macro_value(char *m, char **val)
+{
+    int8_t r = 0;
+
+    if (val)
+    {
+        free(*val);
+        *val = m;
+        return 1;
+    }
+
+    if ('y' == *m && !m[1])
+        r = 2;
+    else if ('m' == *m && !m[1])
+        r = 1;
+    free(m);
+
+    return r;
+}
+
 int8_t
 get_default_value(const char *sopt, char **val)
 {
@@ -438,7 +468,10 @@ eval_expression(uint8_t cmd, const char *opt, char **val)
     case ENABLE_CONFIG:
     case TOGGLE_CONFIG:
     case DISABLE_CONFIG:
-        r = toggle_configs(opt, cmd, *val, true);
+        if (ck->cascade)
+            r = ck->cascade(opt, cmd, *val);
+        else
+            r = toggle_configs(opt, cmd, *val, true);
         break;
 
     default:
@@ -0,0 +1,130 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include "configk.h"
+
+/*
+ * Configuration fingerprint: a Merkle tree over the Kconfig files. The own
+ * hash of a file covers the resolved values of its options in tree order,
+ * the subtree hash covers its name, own hash and the subtree hashes of the
+ * files it sources. Options which are neither set nor unset are left out,
+ * and a value of 'n' hashes as unset, so comments and line order of a
+ * '.config' file do not change the fingerprint.
+ *
+ * Once computed, a change of an option marks its file and the files above
+ * it; only those are rehashed by the next fprint_root().
+ */
+
+enum
+{
+    FOWN = 0x1,         /* own hash is stale */
+    FSUB = 0x2          /* subtree hash is stale */
+};
+
+static uint64_t
+fprint_option(uint64_t h, const cEntry *t)
+{
+    const char *v = "n";
+
+    if (!t->opt_status)
+        return h;
+    if (t->opt_status > 0 && t->opt_value && strcmp(t->opt_value, "n"))
+        v = t->opt_value;
+
+    h = fnv(h, t->opt_name, strlen(t->opt_name) + 1);
+    return fnv(h, v, strlen(v) + 1);
+}
+
+static uint64_t fprint_node(cNode *, bool);
+
+/* hash options of a file and the subtrees of files it sources */
+static void
+fprint_walk(const cNode *c, uint64_t *own, uint64_t *sub, bool force)
+{
+    for (; c; c = c->next)
+    {
+        if (c->type == SENTRY)
+        {
+            uint64_t h = fprint_node((cNode *)c, force);
+            *sub = fnv(*sub, &h, sizeof(h));
+            continue;
+        }
+        if (c->type == CENTRY && own)
+            *own = fprint_option(*own, c->data);
+        fprint_walk(c->down, own, sub, force);
+    }
+
+    return;
+}
+
+static uint64_t
+fprint_node(cNode *f, bool force)
+{
+    sEntry *s = f->data;
+
+    if (!force && !s->f_stale)
+        return s->f_sub;
+
+    uint64_t own = FNVBASIS, sub = FNVBASIS;
+    bool rown = force || (s->f_stale & FOWN);
+    fprint_walk(f->down, rown ? &own : NULL, &sub, force);
+    if (rown)
+        s->f_own = own;
+
+    sub = fnv(sub, s->fname, strlen(s->fname) + 1);
+    s->f_sub = fnv(sub, &s->f_own, sizeof(s->f_own));
+    s->f_stale = 0;
+
+    return s->f_sub;
+}
+
+/* fingerprint of the tree, computed fully on the first call */
+uint64_t
+fprint_root(void)
+{
+    uint64_t h = fprint_node(ck->root_node, !ck->fprint);
+
+    ck->fprint = true;
+    return h;
+}
+
+/* called before an option changes, see journal_record() */
+void
+fprint_touch(const cEntry *t)
+{
+    if (!ck->fprint)
+        return;
+
+    cNode *c = hsearch_kconfigs(t->opt_name);
+    if (!c)
+        return;
+
+    c = filenode(c);
+    sEntry *s = c->data;
+    uint8_t was = s->f_stale;
+
+    s->f_stale |= FOWN;
+    while (!was && c->up)
+    {
+        c = filenode(c->up);
+        s = c->data;
+        was = s->f_stale;
+        s->f_stale |= FSUB;
+    }
+
+    return;
+}
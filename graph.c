@@ -0,0 +1,296 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <ctype.h>
+#include "configk.h"
+
+/*
+ * Symbol graph: options are numbered in tree order and the depends, select
+ * and imply attributes are resolved to edges between them, stored in the
+ * compressed sparse row (CSR) form in both directions.
+ */
+
+typedef struct
+{
+    uint32_t from;
+    uint32_t to;
+    uint8_t type;
+} tEdge; /* edge before it is sorted into CSR */
+
+typedef struct
+{
+    tEdge *edge;
+    uint32_t n;
+    uint32_t sz;
+    gUndef undef;       /* told of references to undefined symbols */
+    void *arg;
+} tList; /* edges found by graph_build() */
+
+static void
+graph_number(sGraph *g, cNode *c)
+{
+    for (; c; c = c->next)
+    {
+        if (c->type == CENTRY || c->type == CHENTRY)
+        {
+            if (g->nsym % 1024 == 0)
+            {
+                g->sym = realloc(g->sym, (g->nsym + 1024) * sizeof(cNode *));
+                if (!g->sym)
+                    failx("could not allocate graph symbols");
+            }
+            ((cEntry *)c->data)->opt_id = g->nsym;
+            g->sym[g->nsym++] = c;
+        }
+        graph_number(g, c->down);
+    }
+
+    return;
+}
+
+static void
+graph_edge(tList *l, uint32_t from, uint32_t to, uint8_t type)
+{
+    if (l->n == l->sz)
+    {
+        l->sz = l->sz ? l->sz * 2 : 4096;
+        if (!(l->edge = realloc(l->edge, l->sz * sizeof(tEdge))))
+            failx("could not allocate graph edges");
+    }
+    l->edge[l->n++] = (tEdge){ from, to, type };
+
+    return;
+}
+
+/*
+ * Scan an attribute expression for symbol names. For select and imply
+ * attributes only the first symbol of each ';' separated clause is the
+ * target, names after 'if' are conditions and are not linked.
+ */
+static void
+graph_scan(sGraph *g, tList *l, uint32_t from, const char *exp, eType type)
+{
+    char name[128];
+    bool target = true;
+    const char *p = exp;
+
+    while (*p)
+    {
+        if (*p == '$' && p[1] == '(')
+        {
+            uint16_t n = 0;
+            do
+            {
+                n += (*p == '(') - (*p == ')');
+                p++;
+            } while (*p && n);
+            continue;
+        }
+        if (*p == '"')
+        {
+            p = strchr(p + 1, '"');
+            p = p ? p + 1 : exp + strlen(exp);
+            continue;
+        }
+        if (*p == ';')
+            target = true;
+        if (!isalnum((uint8_t)*p) && *p != '_')
+        {
+            p++;
+            continue;
+        }
+
+        /* symbols have upper case letters only, ex: 64BIT, not 0x10 or y */
+        uint8_t up = 0, lo = 0;
+        const char *s = p;
+        for (; isalnum((uint8_t)*p) || *p == '_'; p++)
+        {
+            up |= !!isupper((uint8_t)*p);
+            lo |= !!islower((uint8_t)*p);
+        }
+        if (!up || lo || p - s >= (long)sizeof(name))
+            continue;
+        if (type != EDEPENDS && !target)
+            continue;
+        target = false;
+
+        memcpy(name, s, p - s);
+        name[p - s] = '\0';
+        cNode *c = hsearch_kconfigs(name);
+        if (c)
+            graph_edge(l, from, ((cEntry *)c->data)->opt_id, type);
+        else if (l->undef)
+            l->undef(g->sym[from], name, type, l->arg);
+    }
+
+    return;
+}
+
+static void
+graph_csr(const tList *l, uint32_t n, uint32_t **off, gEdge **edge, bool rev)
+{
+    const tEdge *t = l->edge;
+    uint32_t *o = calloc(n + 2, sizeof(uint32_t));
+    gEdge *e = calloc(l->n + 1, sizeof(gEdge));
+    if (!o || !e)
+        failx("could not allocate graph arrays");
+
+    for (uint32_t i = 0; i < l->n; i++)
+        o[(rev ? t[i].to : t[i].from) + 2]++;
+    for (uint32_t i = 2; i < n + 2; i++)
+        o[i] += o[i - 1];
+    for (uint32_t i = 0; i < l->n; i++)
+    {
+        uint32_t f = rev ? t[i].to : t[i].from;
+        e[o[f + 1]].to = rev ? t[i].from : t[i].to;
+        e[o[f + 1]++].type = t[i].type;
+    }
+
+    *off = o;
+    *edge = e;
+    return;
+}
+
+sGraph *
+graph_build(gUndef undef, void *arg)
+{
+    tList l = { NULL, 0, 0, undef, arg };
+    sGraph *g = calloc(1, sizeof(sGraph));
+    if (!g)
+        failx("could not allocate graph");
+
+    graph_number(g, ck->root_node);
+    for (uint32_t i = 0; i < g->nsym; i++)
+    {
+        cEntry *t = g->sym[i]->data;
+        if (t->opt_depends)
+            graph_scan(g, &l, i, t->opt_depends, EDEPENDS);
+        for (bCond *b = t->opt_block; b; b = b->up)
+            if (b->expr)
+                graph_scan(g, &l, i, b->expr, EDEPENDS);
+        if (t->opt_select)
+            graph_scan(g, &l, i, t->opt_select, ESELECT);
+        if (t->opt_imply)
+            graph_scan(g, &l, i, t->opt_imply, EIMPLY);
+    }
+
+    g->nedge = l.n;
+    graph_csr(&l, g->nsym, &g->out, &g->oedge, false);
+    graph_csr(&l, g->nsym, &g->in, &g->iedge, true);
+
+    free(l.edge);
+    return g;
+}
+
+/* new mark to tell options visited by a traversal, see cEntry.opt_mark */
+uint32_t
+graph_mark(void)
+{
+    if (!++ck->mark)
+        ++ck->mark;
+
+    return ck->mark;
+}
+
+/*
+ * Strongly connected components over the edges of 'types', found with an
+ * iterative Tarjan walk. The component of each symbol is stored in 'comp',
+ * numbered sinks first: an edge never leads to a component of a higher
+ * number. Returns the number of components.
+ */
+uint32_t
+graph_scc(const sGraph *g, uint8_t types, uint32_t *comp)
+{
+    uint32_t n = g->nsym, next = 0, ncall = 0, nstk = 0, ncomp = 0;
+    uint32_t *idx = malloc(n * sizeof(uint32_t));
+    uint32_t *low = malloc(n * sizeof(uint32_t));
+    uint32_t *pos = malloc(n * sizeof(uint32_t));
+    uint32_t *call = malloc(n * sizeof(uint32_t));
+    uint32_t *stk = malloc(n * sizeof(uint32_t));
+
+    if (n && (!idx || !low || !pos || !call || !stk))
+        failx("could not allocate graph components");
+    memset(idx, 0xff, n * sizeof(uint32_t));
+    memset(comp, 0xff, n * sizeof(uint32_t));
+
+    for (uint32_t s = 0; s < n; s++)
+    {
+        if (GNONE != idx[s])
+            continue;
+
+        idx[s] = low[s] = next++;
+        pos[s] = g->out[s];
+        stk[nstk++] = call[ncall++] = s;
+        while (ncall)
+        {
+            uint32_t v = call[ncall - 1];
+            if (pos[v] < g->out[v + 1])
+            {
+                const gEdge *e = &g->oedge[pos[v]++];
+                uint32_t w = e->to;
+                if (!(e->type & types))
+                    continue;
+                if (GNONE == idx[w])
+                {
+                    idx[w] = low[w] = next++;
+                    pos[w] = g->out[w];
+                    stk[nstk++] = call[ncall++] = w;
+                }
+                /* visited and without a component: it is on the stack */
+                else if (GNONE == comp[w] && idx[w] < low[v])
+                    low[v] = idx[w];
+                continue;
+            }
+
+            if (--ncall && low[v] < low[call[ncall - 1]])
+                low[call[ncall - 1]] = low[v];
+            if (low[v] != idx[v])
+                continue;
+
+            uint32_t w;
+            do
+            {
+                w = stk[--nstk];
+                comp[w] = ncomp;
+            } while (w != v);
+            ncomp++;
+        }
+    }
+
+    free(idx);
+    free(low);
+    free(pos);
+    free(call);
+    free(stk);
+    return ncomp;
+}
+
+void
+graph_free(sGraph *g)
+{
+    if (!g)
+        return;
+
+    free(g->sym);
+    free(g->out);
+    free(g->oedge);
+    free(g->in);
+    free(g->iedge);
+    free(g);
+
+    return;
+}
@@ -0,0 +1,297 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include "configk.h"
+#include "report.h"
+
+/*
+ * --impact: dry-run of an enable/disable cascade. Options reached through
+ * select/imply, choice and dependency edges are visited once each and
+ * changed in place so that later conditions see the new values; all
+ * changes are recorded in a journal transaction and rolled back before
+ * returning.
+ */
+
+typedef struct
+{
+    cNode *c;
+    uint8_t status;
+    uint16_t depth;
+    const char *val;
+    const char *why;
+} iWork; /* pending visit */
+
+typedef struct
+{
+    cEntry *t;
+    const char *value;  /* previous value, held by the journal */
+    int32_t status;
+    uint16_t depth;
+    const char *why;
+} iSave; /* visited option and its previous state */
+
+typedef struct
+{
+    iWork *work;
+    uint32_t nwork;
+    uint32_t worksz;
+    iSave *save;
+    uint32_t nsave;
+    uint32_t savesz;
+    uint16_t depth;     /* of options pushed now */
+    const char *why;
+    uint32_t mark;
+} iRun; /* state of a run, impact_cascade() finds it in the handle */
+
+extern int8_t eescans(uint8_t, const char *, char **);
+
+static void
+impact_push(iRun *x, cNode *c, uint8_t status, const char *val,
+                                        uint16_t depth, const char *why)
+{
+    if (((cEntry *)c->data)->opt_mark == x->mark)
+        return;
+
+    if (x->nwork == x->worksz)
+    {
+        x->worksz = x->worksz ? x->worksz * 2 : 256;
+        if (!(x->work = realloc(x->work, x->worksz * sizeof(iWork))))
+            failx("could not allocate impact worklist");
+    }
+    x->work[x->nwork++] = (iWork){ c, status, depth, val, why };
+
+    return;
+}
+
+static int8_t
+impact_cascade(const char *sopt, uint8_t status, char *val)
+{
+    iRun *x = ck->cascade_arg;
+    cNode *c = hsearch_kconfigs(sopt);
+    if (!c)
+        return 0;
+
+    /* a module selects options as 'm' at least, others as 'y' */
+    impact_push(x, c, status, val && 'm' == *val ? "m" : NULL,
+                                                        x->depth, x->why);
+    return 1;
+}
+
+static const char *
+impact_value(int32_t status, const char *value)
+{
+    if (status <= 0)
+        return "n";
+
+    return value;
+}
+
+static void
+impact_apply(iRun *x, iWork *w)
+{
+    cEntry *t = w->c->data;
+
+    if (x->nsave == x->savesz)
+    {
+        x->savesz = x->savesz ? x->savesz * 2 : 256;
+        if (!(x->save = realloc(x->save, x->savesz * sizeof(iSave))))
+            failx("could not allocate impact list");
+    }
+    const jEntry *j = journal_record(t);
+    x->save[x->nsave++] = (iSave){ t, j->value, j->status, w->depth, w->why };
+
+    if (DISABLE_CONFIG == w->status)
+    {
+        t->opt_status = -CVALNOSET;
+        return;
+    }
+
+    const char *v = w->val;
+    if (CBOOL == t->opt_type || (CTRISTATE == t->opt_type && !v))
+        v = "y";
+    else if (!v)
+        v = j->value ? j->value : "";
+    free(t->opt_value);
+    t->opt_value = strdup(v);
+    t->opt_status = ('n' == *v) ? -CVALNOSET : (int32_t)t->opt_type;
+
+    return;
+}
+
+static void
+impact_expand(iRun *x, const sGraph *g, const iWork *w)
+{
+    cNode *c = w->c;
+    cEntry *t = c->data;
+    char *val = t->opt_value ? strdup(t->opt_value) : NULL;
+
+    x->depth = w->depth + 1;
+    x->why = "select";
+    if (t->opt_select)
+        eescans(w->status, t->opt_select, &val);
+    x->why = "imply";
+    if (t->opt_imply)
+        eescans(w->status, t->opt_imply, &val);
+    free(val);
+
+    chGroup *grp = (c->type == CENTRY && CBOOL == t->opt_type) ?
+                                                    t->opt_group : NULL;
+    if (grp && ENABLE_CONFIG == w->status && t->opt_status > 0)
+    {
+        for (uint16_t i = 0; i < grp->nmember; i++)
+        {
+            cNode *m = grp->member[i];
+            if (m != c && ((cEntry *)m->data)->opt_status > 0)
+                impact_push(x, m, DISABLE_CONFIG, NULL, x->depth, "choice");
+        }
+    }
+    if (grp && DISABLE_CONFIG == w->status && !choice_active(grp))
+    {
+        cNode *d = choice_default(grp, c);
+        if (d)
+            impact_push(x, d, ENABLE_CONFIG, NULL, x->depth, "choice");
+    }
+
+    if (DISABLE_CONFIG == w->status)
+    {
+        uint32_t id = t->opt_id;
+        for (uint32_t e = g->in[id]; e < g->in[id + 1]; e++)
+        {
+            if (EDEPENDS != g->iedge[e].type)
+                continue;
+
+            cNode *d = g->sym[g->iedge[e].to];
+            cEntry *dt = d->data;
+            if (dt->opt_status > 0 && dt->opt_mark != x->mark
+                && !check_depends(dt->opt_name))
+                impact_push(x, d, DISABLE_CONFIG, NULL, x->depth, "depends");
+        }
+    }
+
+    return;
+}
+
+static void
+impact_report(const iRun *x, const cNode *c, uint8_t status)
+{
+    uint32_t n = 0;
+    cEntry *t = c->data;
+
+    if (!(ropts & R_JSON))
+        printf("%s option '%s':\n", ENABLE_CONFIG == status ?
+                        "Enable" : "Disable", t->opt_name);
+    for (uint32_t i = 0; i < x->nsave; i++)
+    {
+        const iSave *s = &x->save[i];
+        const char *ov = impact_value(s->status, s->value);
+        const char *nv = impact_value(s->t->opt_status, s->t->opt_value);
+        if (ov == nv || (ov && nv && !strcmp(ov, nv)))
+            continue;
+
+        n++;
+        if (ropts & R_JSON)
+        {
+            json_impact(s->t->opt_name, ov, s->t->opt_status > 0
+                                ? s->t->opt_value : "n", s->depth, s->why);
+            continue;
+        }
+        for (uint16_t d = 0; d <= s->depth; d++)
+            printf("  ");
+        printf("%s: %s => %s", s->t->opt_name, ov, nv);
+        if (s->why)
+            printf(" (%s)", s->why);
+        printf("\n");
+    }
+
+    if (ropts & R_JSON)
+        return;
+    printf("Options changed: %u\n", n);
+
+    n = 0;
+    for (uint32_t i = 0; i < x->nsave; i++)
+    {
+        cEntry *s = x->save[i].t;
+        if (s->opt_status > 0 && !check_depends(s->opt_name))
+        {
+            const char *b = block_failed(s->opt_block);
+            if (!n++)
+                printf("Dependency not met:\n");
+            printf("  %s: %s\n", s->opt_name, b ? b : s->opt_depends);
+        }
+    }
+
+    return;
+}
+
+int
+impact_configs(ck_handle *h, const char *sopt)
+{
+    CK_ENTER(h, -1);
+    uint32_t nerrs = h->nerrs;
+    char *opt = strdup(sopt);
+    if (!opt)
+        failx("could not allocate impact option");
+
+    char *val = strchr(opt, '=');
+    uint8_t status = ENABLE_CONFIG;
+
+    if (val)
+    {
+        *val++ = '\0';
+        if ('n' == *val || 'N' == *val)
+            status = DISABLE_CONFIG;
+    }
+
+    cNode *c = hsearch_kconfigs(opt);
+    if (!c)
+    {
+        diagx(DIAG_MISSING, opt,
+                    "option '%s' not found in the source tree", opt);
+        free(opt);
+        return ck_unbind(0);
+    }
+
+    iRun x = { .mark = graph_mark() };
+    sGraph *g = graph_build(NULL, NULL);
+    journal_begin();
+    ck->cascade = impact_cascade;
+    ck->cascade_arg = &x;
+
+    impact_push(&x, c, status, val, 0, NULL);
+    while (x.nwork)
+    {
+        iWork w = x.work[--x.nwork];
+        cEntry *t = w.c->data;
+        if (t->opt_mark == x.mark)
+            continue;
+
+        t->opt_mark = x.mark;
+        impact_apply(&x, &w);
+        impact_expand(&x, g, &w);
+    }
+    ck->cascade = NULL;
+    ck->cascade_arg = NULL;
+
+    impact_report(&x, c, status);
+    journal_rollback();
+
+    free(x.work);
+    free(x.save);
+    graph_free(g);
+    free(opt);
+    return ck_unbind(nerrs != h->nerrs ? -1 : 0);
+}
@@ -0,0 +1,161 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include "configk.h"
+
+/*
+ * Change journal: while a transaction is open, the previous value and
+ * status of an option is recorded before each change. A rollback restores
+ * them back to the transaction mark; a commit of the outermost transaction
+ * leaves its mark in the journal as an undo point.
+ */
+
+static void
+journal_push(cEntry *t, char *value, int32_t status)
+{
+    if (ck->njournal == ck->journalsz)
+    {
+        ck->journalsz = ck->journalsz ? ck->journalsz * 2 : 256;
+        ck->journal = realloc(ck->journal, ck->journalsz * sizeof(jEntry));
+        if (!ck->journal)
+            failx("could not allocate change journal");
+    }
+    ck->journal[ck->njournal++] = (jEntry){ t, value, status };
+
+    return;
+}
+
+/* index of the last mark of a given type, or -1 */
+static int64_t
+journal_mark(int32_t type)
+{
+    int64_t i = ck->njournal;
+
+    while (i--)
+        if (!ck->journal[i].t && type == ck->journal[i].status)
+            break;
+
+    return i;
+}
+
+/* restore options changed after the entry 'n', drop entries from 'n' */
+static void
+journal_restore(uint32_t n)
+{
+    ck->vgen++;
+    while (ck->njournal > n)
+    {
+        jEntry *j = &ck->journal[--ck->njournal];
+        if (!j->t)
+            continue;
+
+        fprint_touch(j->t);
+        free(j->t->opt_value);
+        j->t->opt_value = j->value;
+        j->t->opt_status = j->status;
+        choice_invalidate(j->t);
+    }
+
+    return;
+}
+
+void
+journal_begin(void)
+{
+    journal_push(NULL, NULL, JOPEN);
+    ck->jdepth++;
+
+    return;
+}
+
+/* called before each change of an option value or status */
+const jEntry *
+journal_record(cEntry *t)
+{
+    ck->vgen++;
+    fprint_touch(t);
+    if (!ck->jdepth)
+        return NULL;
+
+    journal_push(t, t->opt_value ? strdup(t->opt_value) : NULL,
+                                                        t->opt_status);
+    return &ck->journal[ck->njournal - 1];
+}
+
+int8_t
+journal_commit(void)
+{
+    if (!ck->jdepth)
+        return -1;
+
+    uint32_t m = journal_mark(JOPEN);
+    if (--ck->jdepth || m == ck->njournal - 1)
+    {
+        /* nested or empty transaction: merge into the enclosing one */
+        memmove(&ck->journal[m], &ck->journal[m + 1],
+                            (ck->njournal - m - 1) * sizeof(jEntry));
+        ck->njournal--;
+    }
+    else
+        ck->journal[m].status = JEDIT;
+
+    return 0;
+}
+
+int8_t
+journal_rollback(void)
+{
+    if (!ck->jdepth)
+        return -1;
+
+    journal_restore(journal_mark(JOPEN));
+    ck->jdepth--;
+
+    return 0;
+}
+
+uint32_t
+journal_undo(uint32_t n)
+{
+    uint32_t r = 0;
+
+    if (ck->jdepth)
+        return r;
+
+    int64_t m;
+    while (r < n && (m = journal_mark(JEDIT)) >= 0)
+    {
+        journal_restore(m);
+        r++;
+    }
+
+    return r;
+}
+
+void
+journal_reset(void)
+{
+    for (uint32_t i = 0; i < ck->njournal; i++)
+        free(ck->journal[i].value);
+    free(ck->journal);
+
+    ck->journal = NULL;
+    ck->njournal = ck->journalsz = 0;
+    ck->jdepth = 0;
+
+    return;
+}
@@ -0,0 +1,321 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "configk.h"
+#include "report.h"
+
+/*
+ * --json output: one JSON object per line (NDJSON) on stdout. It is line
+ * buffered so that pipelines can consume them as the tree is walked; edited
+ * config files are written to streams of their own, see ck_write_config().
+ */
+#define jout stdout
+
+extern const char *dkinds[];
+
+void
+json_init(void)
+{
+    setvbuf(jout, NULL, _IOLBF, 0);
+    return;
+}
+
+static void
+json_string(const char *str)
+{
+    if (!str)
+    {
+        fputs("null", jout);
+        return;
+    }
+
+    fputc('"', jout);
+    for (const unsigned char *s = (const unsigned char *)str; *s; s++)
+    {
+        switch (*s)
+        {
+        case '"':  fputs("\\\"", jout); break;
+        case '\\': fputs("\\\\", jout); break;
+        case '\n': fputs("\\n", jout); break;
+        case '\t': fputs("\\t", jout); break;
+        case '\r': fputs("\\r", jout); break;
+        default:
+            if (*s < 0x20)
+                fprintf(jout, "\\u%04x", *s);
+            else
+                fputc(*s, jout);
+        }
+    }
+    fputc('"', jout);
+
+    return;
+}
+
+static void
+json_field(const char *key, const char *val)
+{
+    fprintf(jout, ",\"%s\":", key);
+    json_string(val);
+
+    return;
+}
+
+static const char *
+json_status(int32_t status)
+{
+    if (!status)
+        return "default";
+    if (status > 0)
+        return "set";
+    if (-CVALNOSET == status)
+        return "unset";
+
+    return "invalid";
+}
+
+void
+json_sentry(const char *file, uint8_t depth, uint32_t files, uint32_t options)
+{
+    fputs("{\"event\":\"file\"", jout);
+    json_field("file", file);
+    fprintf(jout, ",\"depth\":%d,\"files\":%u,\"options\":%u}\n",
+                                                    depth, files, options);
+    return;
+}
+
+/* 'dep' is the value of its dependencies, or -1 */
+void
+json_option(const ck_option *o, int dep, bool full)
+{
+    const char *error = NULL;
+
+    if (o->choice)
+    {
+        fputs("{\"event\":\"choice\"", jout);
+        json_field("file", o->file);
+        json_field("name", o->name);
+        json_field("prompt", o->prompt);
+        fputs("}\n", jout);
+        return;
+    }
+
+    if (o->status < 0 && o->status != -CVALNOSET)
+        error = dkinds[DIAG_INVALID];
+    else if (o->status > 0 && !dep)
+        error = dkinds[DIAG_DEPENDS];
+
+    fputs("{\"event\":\"option\"", jout);
+    json_field("file", o->file);
+    json_field("name", o->name);
+    json_field("type", o->type);
+    json_field("value", o->value);
+    json_field("status", json_status(o->status));
+    if (dep < 0)
+        fputs(",\"depends\":null", jout);
+    else
+        fprintf(jout, ",\"depends\":%d", dep);
+    json_field("error", error);
+    if (full)
+    {
+        json_field("prompt", o->prompt);
+        json_field("range", o->range);
+        json_field("depends_on", o->depends);
+        json_field("select", o->select);
+        json_field("imply", o->imply);
+        json_field("help", o->help);
+    }
+    fputs("}\n", jout);
+
+    return;
+}
+
+void
+json_edit(int edit, const ck_option *o, int depth)
+{
+    const char *action = "toggle";
+
+    if (CK_ENABLE == edit)
+        action = "enable";
+    else if (CK_DISABLE == edit)
+        action = "disable";
+
+    fputs("{\"event\":\"edit\"", jout);
+    json_field("action", action);
+    json_field("name", o->name);
+    json_field("value", -CVALNOSET == o->status ? "n" : o->value);
+    json_field("status", json_status(o->status));
+    fprintf(jout, ",\"depth\":%d}\n", depth);
+
+    return;
+}
+
+void
+json_impact(const char *name, const char *old, const char *value,
+                                            uint16_t depth, const char *why)
+{
+    fputs("{\"event\":\"impact\"", jout);
+    json_field("name", name);
+    json_field("old", old);
+    json_field("value", value);
+    json_field("reason", why);
+    fprintf(jout, ",\"depth\":%d}\n", depth);
+
+    return;
+}
+
+void
+json_search(const char *file, const char *name, const char *prompt,
+                                                            uint32_t score)
+{
+    fputs("{\"event\":\"search\"", jout);
+    json_field("file", file);
+    json_field("name", name);
+    json_field("prompt", prompt);
+    fprintf(jout, ",\"score\":%u}\n", score);
+
+    return;
+}
+
+void
+json_fprint(const char *file, uint64_t sub, uint64_t own, const char *diff)
+{
+    fputs("{\"event\":\"fingerprint\"", jout);
+    json_field("file", file);
+    fprintf(jout, ",\"hash\":\"%016" PRIx64 "\",\"own\":\"%016" PRIx64 "\"",
+                                                                    sub, own);
+    if (diff)
+        json_field("diff", diff);
+    fputs("}\n", jout);
+
+    return;
+}
+
+void
+json_tdiff(const char *file, const char *name, const char *change,
+                        const char *field, const char *old, const char *new)
+{
+    fputs("{\"event\":\"treediff\"", jout);
+    json_field("file", file);
+    json_field("name", name);
+    json_field("change", change);
+    if (field)
+        json_field("field", field);
+    if (old || new)
+    {
+        json_field("old", old);
+        json_field("new", new);
+    }
+    fputs("}\n", jout);
+
+    return;
+}
+
+void
+json_lint(const char *file, const char *name, const char *kind,
+                                                        const char *msg)
+{
+    fputs("{\"event\":\"lint\"", jout);
+    json_field("file", file);
+    json_field("name", name);
+    json_field("kind", kind);
+    json_field("message", msg);
+    fputs("}\n", jout);
+
+    return;
+}
+
+void
+json_mtree(const char *kind, const char *name, const char *msg,
+                                    const char *trees[], uint16_t ntree)
+{
+    fputs("{\"event\":\"tree\"", jout);
+    json_field("kind", kind);
+    json_field("name", *name ? name : NULL);
+    json_field("message", msg);
+    fputs(",\"trees\":[", jout);
+    for (uint16_t i = 0; i < ntree; i++)
+    {
+        if (i)
+            fputc(',', jout);
+        json_string(trees[i]);
+    }
+    fputs("]}\n", jout);
+
+    return;
+}
+
+void
+json_graph(const char *kind, uint32_t count, const char *names[], uint32_t n)
+{
+    fputs("{\"event\":\"graph\"", jout);
+    json_field("kind", kind);
+    fprintf(jout, ",\"count\":%u,\"names\":[", count);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (i)
+            fputc(',', jout);
+        json_string(names[i]);
+    }
+    fputs("]}\n", jout);
+
+    return;
+}
+
+void
+json_solve(const char *name, const char *old, const char *val)
+{
+    fputs("{\"event\":\"solve\"", jout);
+    json_field("name", name);
+    json_field("old", old);
+    json_field("value", val);
+    fputs("}\n", jout);
+
+    return;
+}
+
+void
+json_complete(const char *name)
+{
+    fputs("{\"event\":\"complete\"", jout);
+    json_field("name", name);
+    fputs("}\n", jout);
+
+    return;
+}
+
+void
+json_diag(const char *kind, const char *opt, const char *msg)
+{
+    fputs("{\"event\":\"diag\"", jout);
+    json_field("kind", kind);
+    json_field("name", opt);
+    json_field("message", msg);
+    fputs("}\n", jout);
+
+    return;
+}
+
+void
+json_summary(uint32_t files, uint32_t options)
+{
+    fprintf(jout, "{\"event\":\"summary\",\"files\":%u,\"options\":%u}\n",
+                                                            files, options);
+    fflush(jout);
+
+    return;
+}
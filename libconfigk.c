@@ -0,0 +1,494 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "configk.h"
+#include "libconfigk.h"
+
+/*
+ * All state of a loaded tree lives in its handle. The flex/bison scanners
+ * are not re-entrant, so each call binds its handle to 'ck' under 'cklock'
+ * and the engine works on that one until the call returns.
+ */
+static pthread_mutex_t cklock = PTHREAD_MUTEX_INITIALIZER;
+extern const char *types[];
+extern int yylex_destroy(void);
+extern int eelex_destroy(void);
+
+/* bind 'h', returns -1 if an earlier failure left it unusable */
+int
+ck_bind(ck_handle *h)
+{
+    pthread_mutex_lock(&cklock);
+    ck = h;
+    if (h->failed)
+        return -1;
+
+    ck->error[0] = '\0';
+    return 0;
+}
+
+int
+ck_unbind(int r)
+{
+    pthread_mutex_unlock(&cklock);
+    return r;
+}
+
+/* back from failx(): stop the readers, drop the scanner buffers */
+int
+ck_failed(int r)
+{
+    prefetch_stop();
+    locate_free();
+    yylex_destroy();
+    eelex_destroy();
+
+    return ck_unbind(r);
+}
+
+static int
+ck_fail(const char *msg, const char *opt)
+{
+    snprintf(ck->error, sizeof(ck->error), msg, opt);
+    return ck_unbind(-1);
+}
+
+ck_handle *
+ck_open(const char *arch)
+{
+    ckHandle *h = calloc(1, sizeof(ckHandle));
+    if (!h)
+        return h;
+
+    if (!hcreate_r(HASHSZ, &h->c_chash))
+    {
+        free(h);
+        return NULL;
+    }
+    if (!arch)
+        arch = getenv("SRCARCH");
+    if (!(h->c_gstr[IARCH] = strdup(arch ? arch : "x86")))
+    {
+        hdestroy_r(&h->c_chash);
+        free(h);
+        return NULL;
+    }
+    h->c_opts = OUT_QUIET;
+    h->srcfd = -1;
+
+    return h;
+}
+
+int
+ck_load_tree(ck_handle *h, const char *srcdir)
+{
+    CK_ENTER(h, -1);
+    if (h->root_node)
+        return ck_fail("tree already loaded from: %s", srcdir);
+
+    uint32_t n = h->nerrs;
+    if (read_kconfigs(srcdir, NULL) < 0 || n != h->nerrs)
+        return ck_unbind(-1);
+
+    return ck_unbind(0);
+}
+
+int
+ck_load_symbol(ck_handle *h, const char *srcdir, const char *name)
+{
+    CK_ENTER(h, -1);
+    if (h->root_node)
+        return ck_fail("tree already loaded from: %s", srcdir);
+
+    uint32_t n = h->nerrs;
+    if (read_kconfigs(srcdir, name) < 0 || n != h->nerrs)
+        return ck_unbind(-1);
+
+    return ck_unbind(0);
+}
+
+int
+ck_load_config(ck_handle *h, const char *cfile)
+{
+    CK_ENTER(h, -1);
+    if (!h->root_node)
+        return ck_fail("no tree loaded to check: %s", cfile);
+
+    h->c_postedit = 0;
+    return ck_unbind(check_kconfigs(cfile));
+}
+
+int
+ck_write_config(ck_handle *h, const char *cfile, FILE *out)
+{
+    CK_ENTER(h, -1);
+    if (!h->root_node)
+        return ck_fail("no tree loaded to write: %s", cfile);
+
+    h->cout = out;
+    h->c_postedit = SHOW_CONFIG;
+    int r = check_kconfigs(cfile);
+    h->c_postedit = 0;
+    h->cout = NULL;
+    if (!r && fflush(out))
+        return ck_fail("could not write config: %s", cfile);
+
+    return ck_unbind(r);
+}
+
+int
+ck_apply_config(ck_handle *h, const char *cfile)
+{
+    CK_ENTER(h, -1);
+    if (!h->root_node)
+        return ck_fail("no tree loaded to edit: %s", cfile);
+
+    /* edits of the file are one undo step */
+    h->c_postedit = EDIT_CONFIG;
+    journal_begin();
+    int r = check_kconfigs(cfile);
+    if (r)
+        journal_rollback();
+    else
+        journal_commit();
+    h->c_postedit = 0;
+
+    return ck_unbind(r);
+}
+
+void
+ck_option_fill(ck_option *o, const cNode *c)
+{
+    cEntry *t = c->data;
+
+    o->name = t->opt_name;
+    o->file = ((sEntry *)filenode((cNode *)c)->data)->fname;
+    o->type = types[t->opt_type];
+    o->value = t->opt_value;
+    o->prompt = t->opt_prompt;
+    o->depends = t->opt_depends;
+    o->select = t->opt_select;
+    o->imply = t->opt_imply;
+    o->range = t->opt_range;
+    o->help = t->opt_help;
+    o->status = t->opt_status;
+    o->choice = (c->type == CHENTRY);
+
+    return;
+}
+
+int
+ck_lookup(ck_handle *h, const char *name, ck_option *o)
+{
+    CK_ENTER(h, -1);
+
+    cNode *c = hsearch_kconfigs(name);
+    if (!c)
+        return ck_fail("option '%s' not found in the source tree", name);
+
+    ck_option_fill(o, c);
+    return ck_unbind(0);
+}
+
+int
+ck_depends(ck_handle *h, const char *name, int *result)
+{
+    CK_ENTER(h, -1);
+
+    cNode *c = hsearch_kconfigs(name);
+    if (!c)
+        return ck_fail("option '%s' not found in the source tree", name);
+
+    *result = check_depends(name);
+    return ck_unbind(0);
+}
+
+int
+ck_range(ck_handle *h, const char *name, char **range)
+{
+    CK_ENTER(h, -1);
+
+    cNode *c = hsearch_kconfigs(name);
+    if (!c)
+        return ck_fail("option '%s' not found in the source tree", name);
+
+    const char *r = ((cEntry *)c->data)->opt_range;
+    *range = r ? gets_range(r) : NULL;
+    return ck_unbind(0);
+}
+
+int
+ck_blocks(ck_handle *h, const char *name, ck_block_fn fn, void *arg)
+{
+    CK_ENTER(h, -1);
+
+    cNode *c = hsearch_kconfigs(name);
+    if (!c)
+        return ck_fail("option '%s' not found in the source tree", name);
+
+    for (bCond *b = ((cEntry *)c->data)->opt_block; b; b = b->up)
+        if (b->expr)
+            fn(b->expr, block_eval(b), arg);
+
+    return ck_unbind(0);
+}
+
+int
+ck_edit(ck_handle *h, const char *name, int edit, const char *val)
+{
+    CK_ENTER(h, -1);
+
+    if (edit != CK_ENABLE && edit != CK_DISABLE && edit != CK_TOGGLE)
+        return ck_fail("invalid edit operation for option '%s'", name);
+
+    /* 'val' is only copied by set_option(), never written */
+    journal_begin();
+    if (!toggle_configs(name, edit, (char *)val, true))
+    {
+        journal_rollback();
+        return ck_fail("could not edit option '%s'", name);
+    }
+    journal_commit();
+
+    return ck_unbind(0);
+}
+
+int
+ck_begin(ck_handle *h)
+{
+    CK_ENTER(h, -1);
+    journal_begin();
+
+    return ck_unbind(0);
+}
+
+int
+ck_commit(ck_handle *h)
+{
+    CK_ENTER(h, -1);
+    if (journal_commit() < 0)
+        return ck_fail("no transaction to commit", NULL);
+
+    return ck_unbind(0);
+}
+
+int
+ck_rollback(ck_handle *h)
+{
+    CK_ENTER(h, -1);
+    if (journal_rollback() < 0)
+        return ck_fail("no transaction to roll back", NULL);
+
+    return ck_unbind(0);
+}
+
+int
+ck_undo(ck_handle *h, unsigned int n)
+{
+    CK_ENTER(h, -1);
+    if (h->jdepth)
+        return ck_fail("could not undo in an open transaction", NULL);
+
+    return ck_unbind(journal_undo(n));
+}
+
+int
+ck_fingerprint(ck_handle *h, unsigned long long *hash)
+{
+    CK_ENTER(h, -1);
+    if (!h->root_node)
+        return ck_fail("no tree loaded to fingerprint", NULL);
+
+    *hash = fprint_root();
+    return ck_unbind(0);
+}
+
+static int
+ck_walk(const cNode *c, ck_iter_fn fn, void *arg)
+{
+    int r = 0;
+    ck_option o;
+
+    for (; c && !r; c = c->next)
+    {
+        if (c->type == CENTRY || c->type == CHENTRY)
+        {
+            ck_option_fill(&o, c);
+            if ((r = fn(&o, arg)))
+                break;
+        }
+        r = ck_walk(c->down, fn, arg);
+    }
+
+    return r;
+}
+
+int
+ck_foreach(ck_handle *h, ck_iter_fn fn, void *arg)
+{
+    CK_ENTER(h, -1);
+    return ck_unbind(ck_walk(h->root_node, fn, arg));
+}
+
+int
+ck_search(ck_handle *h, const char *query, ck_iter_fn fn, void *arg)
+{
+    int r = 0;
+    sHit *hits;
+    ck_option o;
+
+    CK_ENTER(h, -1);
+    uint32_t n = search_configs(query, &hits);
+    for (uint32_t i = 0; i < n && !r; i++)
+    {
+        ck_option_fill(&o, hits[i].c);
+        r = fn(&o, arg);
+    }
+    free(hits);
+
+    return ck_unbind(r);
+}
+
+int
+ck_match(ck_handle *h, const char *pattern, ck_iter_fn fn, void *arg)
+{
+    int r = 0;
+    ck_option o;
+    cNode *c, **m = NULL;
+
+    CK_ENTER(h, -1);
+    if (!prefix_glob(pattern))
+    {
+        if (!(c = hsearch_kconfigs(pattern)) || c->type == SENTRY)
+            return ck_fail("option '%s' not found in the source tree",
+                                                                    pattern);
+        ck_option_fill(&o, c);
+        return ck_unbind(fn(&o, arg));
+    }
+
+    uint32_t n = prefix_match(pattern, &m);
+    for (uint32_t i = 0; i < n && !r; i++)
+    {
+        ck_option_fill(&o, m[i]);
+        r = fn(&o, arg);
+    }
+    free(m);
+    if (!n)
+        return ck_fail("no option matches '%s' in the source tree", pattern);
+
+    return ck_unbind(r);
+}
+
+int
+ck_complete(ck_handle *h, const char *srcdir, const char *prefix,
+                                                    ck_name_fn fn, void *arg)
+{
+    CK_ENTER(h, -1);
+    if (h->root_node)
+    {
+        prefix_each(NULL, prefix, fn, arg);
+        return ck_unbind(0);
+    }
+    if (!srcdir)
+        return ck_fail("no tree loaded to complete: %s", prefix);
+
+    return ck_unbind(locate_complete(srcdir, prefix, fn, arg));
+}
+
+void
+ck_set_flags(ck_handle *h, int flags)
+{
+    ck_bind(h);
+    h->c_opts = (flags & CK_VERBOSE) ? OUT_VERBOSE : OUT_QUIET;
+    ck_unbind(0);
+
+    return;
+}
+
+void
+ck_set_diag(ck_handle *h, ck_diag_fn fn, void *arg)
+{
+    ck_bind(h);
+
+    h->diag = fn;
+    h->diag_arg = arg;
+
+    ck_unbind(0);
+    return;
+}
+
+void
+ck_set_trace(ck_handle *h, ck_trace_fn fn, void *arg)
+{
+    ck_bind(h);
+
+    h->trace = fn;
+    h->trace_arg = arg;
+
+    ck_unbind(0);
+    return;
+}
+
+const char *
+ck_error(const ck_handle *h)
+{
+    return h->error;
+}
+
+unsigned int
+ck_release(ck_handle *h)
+{
+    uint32_t tmem = 0;
+
+    /* a handle left by a failure is freed as well */
+    ck_bind(h);
+    if (h->root_node)
+        tmem = tree_reset(h->root_node);
+    tmem += search_free();
+    tmem += prefix_free(NULL);
+    tmem += block_free();
+    tmem += config_free();
+    tmem += toggle_free();
+    tmem += macro_free();
+    tmem += h->journalsz * sizeof(jEntry);
+    journal_reset();
+    tmem += (HASHSZ * sizeof(h->c_chash));
+    hdestroy_r(&h->c_chash);
+    for (uint8_t n = 0; n < GSTRSZ; n++)
+    {
+        tmem += h->c_gstr[n] ? strlen(h->c_gstr[n]) : 0;
+        free(h->c_gstr[n]);
+    }
+    if (h->srcfd >= 0)
+        close(h->srcfd);
+    ck = NULL;
+    free(h);
+
+    ck_unbind(0);
+    return tmem;
+}
+
+void
+ck_free(ck_handle *h)
+{
+    if (h)
+        ck_release(h);
+    return;
+}
@@ -0,0 +1,131 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#ifndef LIBCONFIGK_H
+#define LIBCONFIGK_H
+
+#include <stdio.h>
+
+/*
+ * libconfigk: Kconfig tree parsing, lookup, validation and edit API.
+ *
+ * A handle holds one loaded source tree along with the option values read
+ * from a '.config' file. Functions return 0 on success and -1 on failure;
+ * ck_error() then describes the failure. A failure to allocate memory or
+ * to parse a Kconfig file leaves the handle unusable: later calls fail with
+ * the same error, it can only be freed. Handles keep their own state and
+ * the cwd of the process is not changed. Calls may be made from any thread,
+ * they are serialised internally as the Kconfig scanner is not re-entrant.
+ *
+ * Each ck_edit() is recorded as one undo step. Edits made between
+ * ck_begin() and ck_commit() are one step, ck_rollback() reverts them;
+ * transactions may be nested. ck_undo() reverts up to 'n' steps and returns
+ * the number reverted.
+ *
+ * ck_search() calls the iterator on options whose name, prompt or help text
+ * contain all words of a query, best matches first. ck_match() calls it on
+ * options whose name matches a glob(7) pattern, in name order, and fails
+ * when none does. ck_complete() calls its function on the names beginning
+ * with a prefix; without a loaded tree they are read from the symbol index
+ * of 'srcdir', no Kconfig file is parsed.
+ *
+ * ck_write_config() writes a '.config' file to 'out' with the values of
+ * the tree, in the order and with the comments of the file. ck_apply_config()
+ * edits the options whose value differs in the file, as one undo step.
+ *
+ * Warnings of a call are passed to the diagnostic callback, or written to
+ * stderr with the CK_VERBOSE flag; its error is only told by ck_error().
+ * The trace callback is called with each option an edit changes, 'depth'
+ * in its select/imply cascade, and a line telling why or NULL. Callbacks
+ * and iterators run inside the call: they must not call the library.
+ *
+ * ck_fingerprint() returns a hash of the option values, which does not
+ * depend on comments or line order of the '.config' file. After edits only
+ * the Kconfig files holding the changed options are hashed again.
+ */
+
+#define CK_API_VERSION 6
+
+typedef struct ck_handle ck_handle;
+
+enum ck_flag
+{
+    CK_VERBOSE = 0x1
+};
+
+enum ck_edit
+{
+    CK_DISABLE = 0x4,
+    CK_ENABLE = 0x8,
+    CK_TOGGLE = 0x10
+};
+
+typedef struct
+{
+    const char *name;
+    const char *file;       /* Kconfig file defining the option */
+    const char *type;       /* int, hex, bool, string, tristate */
+    const char *value;
+    const char *prompt;
+    const char *depends;
+    const char *select;
+    const char *imply;
+    const char *range;
+    const char *help;
+    int status;             /* >0: set, 0: not set, <0: unset or invalid */
+    int choice;             /* option is a choice group */
+} ck_option;
+
+/* diagnostic callback: kind name, option name or NULL, message */
+typedef void (*ck_diag_fn)(const char *, const char *, const char *, void *);
+/* option iterator: return non-zero to stop the iteration */
+typedef int (*ck_iter_fn)(const ck_option *, void *);
+/* edit trace: option changed, edit, depth, line telling why or NULL */
+typedef void (*ck_trace_fn)(const ck_option *, int, int, const char *, void *);
+/* name iterator: return non-zero to stop the iteration */
+typedef int (*ck_name_fn)(const char *, void *);
+/* enclosing if/menu block: its condition and value, innermost first */
+typedef void (*ck_block_fn)(const char *, int, void *);
+
+extern ck_handle *ck_open(const char *arch);
+extern int ck_load_tree(ck_handle *, const char *srcdir);
+extern int ck_load_symbol(ck_handle *, const char *srcdir, const char *name);
+extern int ck_load_config(ck_handle *, const char *cfile);
+extern int ck_write_config(ck_handle *, const char *cfile, FILE *out);
+extern int ck_apply_config(ck_handle *, const char *cfile);
+extern int ck_lookup(ck_handle *, const char *name, ck_option *);
+extern int ck_depends(ck_handle *, const char *name, int *result);
+extern int ck_range(ck_handle *, const char *name, char **range);
+extern int ck_blocks(ck_handle *, const char *name, ck_block_fn, void *);
+extern int ck_edit(ck_handle *, const char *name, int edit, const char *val);
+extern int ck_begin(ck_handle *);
+extern int ck_commit(ck_handle *);
+extern int ck_rollback(ck_handle *);
+extern int ck_undo(ck_handle *, unsigned int n);
+extern int ck_fingerprint(ck_handle *, unsigned long long *hash);
+extern int ck_foreach(ck_handle *, ck_iter_fn, void *);
+extern int ck_search(ck_handle *, const char *query, ck_iter_fn, void *);
+extern int ck_match(ck_handle *, const char *pattern, ck_iter_fn, void *);
+extern int ck_complete(ck_handle *, const char *srcdir, const char *prefix,
+                                                        ck_name_fn, void *);
+extern void ck_set_flags(ck_handle *, int flags);
+extern void ck_set_diag(ck_handle *, ck_diag_fn, void *);
+extern void ck_set_trace(ck_handle *, ck_trace_fn, void *);
+extern const char *ck_error(const ck_handle *);
+extern unsigned int ck_release(ck_handle *);
+extern void ck_free(ck_handle *);
+
+#endif
@@ -0,0 +1,269 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include "configk.h"
+#include "report.h"
+
+/*
+ * --lint: checks of the whole tree, made on the symbol graph without
+ * evaluating any expression. References to undefined symbols are reported
+ * while the graph is built. A selected option whose dependencies are all
+ * and-ed together must not depend on symbols which are neither
+ * dependencies of the selecting option, direct or through other
+ * dependencies, nor selected by it. Those dependencies are computed once
+ * for the whole graph, see lint_deps(). Literal int and hex defaults are
+ * checked against a literal range, and options defined more than once are
+ * reported with the last file defining them.
+ */
+
+static void
+lint_report(uint32_t *nlint, const cNode *c, const char *kind,
+                                                    const char *format, ...)
+{
+    char msg[512];
+    va_list ap;
+    const cEntry *t = c->data;
+    const sEntry *s = filenode((cNode *)c)->data;
+
+    va_start(ap, format);
+    vsnprintf(msg, sizeof(msg), format, ap);
+    va_end(ap);
+
+    (*nlint)++;
+    if (ropts & R_JSON)
+        json_lint(s->fname, t->opt_name, kind, msg);
+    else
+        printf("%s: %s: %s\n", s->fname, t->opt_name, msg);
+
+    return;
+}
+
+static void
+lint_undef(const cNode *c, const char *name, eType type, void *nlint)
+{
+    const char *how = "depends on";
+
+    if (ESELECT == type)
+        how = "selects";
+    else if (EIMPLY == type)
+        how = "implies";
+    lint_report(nlint, c, "undefined", "%s undefined symbol '%s'", how, name);
+
+    return;
+}
+
+/* dependencies are one conjunction: each symbol of them is required */
+static bool
+lint_conjunct(const cEntry *t)
+{
+    if (t->opt_depends && strpbrk(t->opt_depends, "|!"))
+        return false;
+    for (const bCond *b = t->opt_block; b; b = b->up)
+        if (b->expr && strpbrk(b->expr, "|!"))
+            return false;
+
+    return true;
+}
+
+typedef struct
+{
+    uint32_t *comp;     /* component of each symbol, see graph_scc() */
+    uint32_t *col;      /* bit of a symbol in the sets, or GNONE */
+    uint64_t *set;      /* dependencies of each component, 'nword' each */
+    uint32_t nword;
+} lDeps; /* transitive dependencies */
+
+/*
+ * Dependencies of each component of the depends edges, in the order
+ * graph_scc() numbers them: those of a component are complete before the
+ * ones which depend on it are computed. A set only holds the symbols some
+ * selected option depends on, the ones lint_select() looks up.
+ */
+static void
+lint_deps(const sGraph *g, lDeps *l)
+{
+    uint32_t n = g->nsym, nbit = 0;
+
+    l->comp = malloc((n + 1) * sizeof(uint32_t));
+    l->col = malloc((n + 1) * sizeof(uint32_t));
+    uint32_t *first = malloc((n + 2) * sizeof(uint32_t));
+    uint32_t *order = malloc((n + 1) * sizeof(uint32_t));
+    if (!l->comp || !l->col || !first || !order)
+        failx("could not allocate lint dependencies");
+
+    uint32_t ncomp = graph_scc(g, EDEPENDS, l->comp);
+    memset(l->col, 0xff, n * sizeof(uint32_t));
+    for (uint32_t i = 0; i < n; i++)
+        for (uint32_t e = g->out[i]; e < g->out[i + 1]; e++)
+        {
+            uint32_t s = g->oedge[e].to;
+            if (ESELECT != g->oedge[e].type)
+                continue;
+            for (uint32_t d = g->out[s]; d < g->out[s + 1]; d++)
+                if (EDEPENDS == g->oedge[d].type
+                    && GNONE == l->col[g->oedge[d].to])
+                    l->col[g->oedge[d].to] = nbit++;
+        }
+
+    l->nword = (nbit + 63) / 64;
+    l->set = calloc((size_t)ncomp * l->nword + 1, sizeof(uint64_t));
+    if (!l->set)
+        failx("could not allocate lint dependencies");
+
+    /* symbols grouped by component */
+    memset(first, 0, (ncomp + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < n; i++)
+        first[l->comp[i] + 1]++;
+    for (uint32_t c = 0; c < ncomp; c++)
+        first[c + 1] += first[c];
+    for (uint32_t i = 0; i < n; i++)
+        order[first[l->comp[i]]++] = i;
+    for (uint32_t c = ncomp; c > 0; c--)
+        first[c] = first[c - 1];
+    first[0] = 0;
+
+    for (uint32_t c = 0; c < ncomp; c++)
+    {
+        uint64_t *set = l->set + (size_t)c * l->nword;
+        for (uint32_t k = first[c]; k < first[c + 1]; k++)
+        {
+            uint32_t v = order[k];
+            if (GNONE != l->col[v])
+                set[l->col[v] / 64] |= 1ULL << (l->col[v] % 64);
+            for (uint32_t e = g->out[v]; e < g->out[v + 1]; e++)
+            {
+                uint32_t dc = l->comp[g->oedge[e].to];
+                if (EDEPENDS != g->oedge[e].type || dc == c)
+                    continue;
+
+                const uint64_t *ds = l->set + (size_t)dc * l->nword;
+                for (uint32_t w = 0; w < l->nword; w++)
+                    set[w] |= ds[w];
+            }
+        }
+    }
+
+    free(first);
+    free(order);
+    return;
+}
+
+/* a select of 'i' whose dependencies 'i' neither has nor selects */
+static void
+lint_select(const sGraph *g, const lDeps *l, uint32_t i, uint32_t *nlint)
+{
+    const uint64_t *has = l->set + (size_t)l->comp[i] * l->nword;
+    uint32_t m = graph_mark();
+
+    for (uint32_t e = g->out[i]; e < g->out[i + 1]; e++)
+        if (ESELECT == g->oedge[e].type)
+            ((cEntry *)g->sym[g->oedge[e].to]->data)->opt_mark = m;
+
+    for (uint32_t e = g->out[i]; e < g->out[i + 1]; e++)
+    {
+        uint32_t s = g->oedge[e].to;
+        cEntry *st = g->sym[s]->data;
+        if (ESELECT != g->oedge[e].type || !lint_conjunct(st))
+            continue;
+
+        for (uint32_t d = g->out[s]; d < g->out[s + 1]; d++)
+        {
+            uint32_t b = l->col[g->oedge[d].to];
+            cEntry *dt = g->sym[g->oedge[d].to]->data;
+            if (EDEPENDS != g->oedge[d].type || dt->opt_mark == m
+                || has[b / 64] & (1ULL << (b % 64)))
+                continue;
+
+            lint_report(nlint, g->sym[i], "select",
+                    "selects '%s' which depends on '%s'",
+                    st->opt_name, dt->opt_name);
+            break;
+        }
+    }
+
+    return;
+}
+
+static void
+lint_range(const cNode *c, uint32_t *nlint)
+{
+    const cEntry *t = c->data;
+    const char *d = t->opt_default ? t->opt_default : t->opt_value;
+    long r1, r2;
+    int n = 0;
+
+    /* "0" is also set by the parser to an int without a default */
+    if (!d || !strcmp(d, "0") || !t->opt_range
+        || strpbrk(t->opt_range, ";\n")
+        || sscanf(t->opt_range, "%li %li %n", &r1, &r2, &n) < 2
+        || t->opt_range[n])
+        return;
+
+    char *p, *dv = strdup(d);
+    for (char *s = strtok_r(dv, ";\n\t", &p); s;
+                                        s = strtok_r(NULL, ";\n\t", &p))
+    {
+        char *e;
+        s += strspn(s, " ");
+        s[strcspn(s, " ")] = '\0';
+        long v = strtol(s, &e, 0);
+        if (e == s || *e || (r1 <= v && v <= r2))
+            continue;
+
+        lint_report(nlint, c, "range",
+                        "default %s out of range [%s]", s, t->opt_range);
+    }
+    free(dv);
+
+    return;
+}
+
+/* lint the tree, returns the number of problems found */
+int
+lint_kconfigs(ck_handle *h)
+{
+    CK_ENTER(h, -1);
+    uint32_t nerrs = h->nerrs;
+    uint32_t nlint = 0;
+    sGraph *g = graph_build(lint_undef, &nlint);
+    lDeps l;
+
+    lint_deps(g, &l);
+
+    for (uint32_t i = 0; i < g->nsym; i++)
+    {
+        cNode *c = g->sym[i];
+        cEntry *t = c->data;
+
+        if (g->out[i] < g->out[i + 1])
+            lint_select(g, &l, i, &nlint);
+        if (CINT == t->opt_type || CHEX == t->opt_type)
+            lint_range(c, &nlint);
+        if (t->opt_ndef > 1)
+            lint_report(&nlint, c, "duplicate", "defined %u times, last in %s",
+                                                t->opt_ndef, t->opt_dfile);
+    }
+    if (!(ropts & R_JSON))
+        printf("Lint warnings: %u\n", nlint);
+
+    free(l.comp);
+    free(l.col);
+    free(l.set);
+    graph_free(g);
+    return ck_unbind(nerrs != h->nerrs ? -1 : (int)nlint);
+}
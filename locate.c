@@ -0,0 +1,510 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include "configk.h"
+
+/*
+ * Symbol locator: a query of one option parses only the Kconfig files which
+ * define it and the options its conditions refer to. The files defining
+ * each symbol are found by a scan of 'source' and 'config' lines without
+ * the parser. The scan also keeps the 'if' and 'menu ... depends on' block
+ * conditions around the 'source' line of each file; they are pushed before
+ * the file is parsed, so that its options have the blocks of a full parse.
+ * The result is kept in an index file in the cache directory, used again
+ * while all indexed files keep their size and modification time.
+ * --complete reads symbol names from it without parsing any file.
+ */
+
+#define LOCATESZ 65536
+#define LBLOCKSZ 64         /* nested blocks kept in a file */
+#define LVERSION "V\t2"     /* index format, an older one is rebuilt */
+
+typedef struct
+{
+    char *fname;
+    int64_t mtime;
+    int64_t size;
+    char **cond;        /* block conditions around it, outer first */
+    uint16_t ncond;
+} lFile; /* indexed Kconfig file */
+
+typedef struct
+{
+    char *name;
+    uint32_t file;
+    uint32_t next;      /* next definition + 1, or 0 */
+} lSym; /* symbol definition */
+
+struct l_index
+{
+    lFile *file;        /* files in tree order */
+    uint32_t nfile;
+    uint32_t filesz;
+    lSym *sym;
+    uint32_t nsym;
+    uint32_t symsz;
+    struct hsearch_data h;  /* symbol => first definition + 1 */
+}; /* in the handle from locate_init() to locate_free() */
+
+#define lx (*ck->lindex)
+
+static uint32_t
+locate_file(char *fname, int64_t mtime, int64_t size)
+{
+    if (lx.nfile == lx.filesz)
+    {
+        lx.filesz = lx.filesz ? lx.filesz * 2 : 1024;
+        lx.file = realloc(lx.file, lx.filesz * sizeof(lFile));
+        if (!lx.file)
+            failx("could not allocate symbol index");
+    }
+    lx.file[lx.nfile] = (lFile){ fname, mtime, size, NULL, 0 };
+
+    return lx.nfile++;
+}
+
+/* add block condition 'expr' to the last file */
+static void
+locate_cond(char *expr)
+{
+    lFile *f = &lx.file[lx.nfile - 1];
+
+    if (f->ncond % 8 == 0)
+    {
+        f->cond = realloc(f->cond, (f->ncond + 8) * sizeof(char *));
+        if (!f->cond)
+            failx("could not allocate symbol index");
+    }
+    f->cond[f->ncond++] = expr;
+
+    return;
+}
+
+static void
+locate_sym(char *name, uint32_t file)
+{
+    ENTRY e = { name, NULL }, *r;
+
+    if (lx.nsym == lx.symsz)
+    {
+        lx.symsz = lx.symsz ? lx.symsz * 2 : 4096;
+        lx.sym = realloc(lx.sym, lx.symsz * sizeof(lSym));
+        if (!lx.sym)
+            failx("could not allocate symbol index");
+    }
+    lx.sym[lx.nsym] = (lSym){ name, file, 0 };
+
+    if (hsearch_r(e, FIND, &r, &lx.h) && r)
+    {
+        uint32_t i = (uintptr_t)r->data - 1;
+        while (lx.sym[i].next)
+            i = lx.sym[i].next - 1;
+        lx.sym[i].next = lx.nsym + 1;
+    }
+    else
+    {
+        e.data = (void *)(uintptr_t)(lx.nsym + 1);
+        if (!hsearch_r(e, ENTER, &r, &lx.h))
+            failx("could not hash symbol '%s'", name);
+    }
+    lx.nsym++;
+
+    return;
+}
+
+/* symbol of a '(menu)config' line, same as the lexer.l rules */
+static void
+locate_config(const char *l, const char *e, uint32_t file)
+{
+    while (l < e && (' ' == *l || '\t' == *l))
+        l++;
+    if (e - l > 4 && !memcmp(l, "menu", 4))
+        l += 4;
+    if (e - l < 8 || memcmp(l, "config", 6) || (' ' != l[6] && '\t' != l[6]))
+        return;
+
+    for (l += 7; l < e && (' ' == *l || '\t' == *l); l++);
+    const char *s = l;
+    while (l < e && ('_' == *l || (*l >= '0' && *l <= '9')
+            || (*l >= 'A' && *l <= 'Z') || (*l >= 'a' && *l <= 'z')))
+        l++;
+    if (l > s)
+        locate_sym(strndup(s, l - s), file);
+
+    return;
+}
+
+/* keyword 'k' at the start of line 'l', followed by a blank if 'arg' */
+static bool
+locate_key(const char *l, const char *e, const char *k, bool arg)
+{
+    size_t n = strlen(k);
+
+    if ((size_t)(e - l) < n + arg || memcmp(l, k, n))
+        return false;
+
+    return !arg || ' ' == l[n] || '\t' == l[n];
+}
+
+/* text after a keyword and its blanks, as the lexer reads it */
+static char *
+locate_text(const char *l, const char *e)
+{
+    while (l < e && (' ' == *l || '\t' == *l))
+        l++;
+
+    return strndup(l, e - l);
+}
+
+/*
+ * Walk files as the parser does, depth first from 'source' lines. Blocks
+ * are opened and closed by the same lines as the parser.y rules: 'if' and
+ * 'menu' at the start of a line, 'depends on' lines after a 'menu' add to
+ * its condition until the next entry. 'cond' are the conditions around the
+ * 'source' line of 'fname'.
+ */
+static void
+locate_scan(const char *fname, struct hsearch_data *seen, char **cond,
+                                                            uint16_t ncond)
+{
+    ENTRY e = { (char *)fname, NULL }, *r;
+    char *blk[LBLOCKSZ];
+    uint16_t depth = 0;
+    bool mb = false;
+    int64_t mtime;
+    size_t len;
+
+    if (hsearch_r(e, FIND, &r, seen) && r)
+        return;
+
+    const char *buf = prefetch_buf(fname, &len, &mtime);
+    if (!buf)
+        return;
+
+    uint32_t f = locate_file(strdup(fname), mtime, len);
+    e.key = lx.file[f].fname;
+    hsearch_r(e, ENTER, &r, seen);
+    for (uint16_t i = 0; i < ncond; i++)
+        locate_cond(strdup(cond[i]));
+
+    for (const char *l = buf, *end = buf + len; l < end; )
+    {
+        const char *nl = memchr(l, '\n', end - l), *le = nl ? nl : end;
+        const char *t = l;
+        char *src = prefetch_source(gstr[IARCH], l, le);
+
+        while (t < le && (' ' == *t || '\t' == *t))
+            t++;
+        if (src)
+        {
+            char **c = malloc((ncond + depth + 1) * sizeof(char *));
+            uint16_t n = ncond;
+            if (!c)
+                failx("could not allocate symbol index");
+            memcpy(c, cond, ncond * sizeof(char *));
+            for (uint16_t i = 0; i < depth && i < LBLOCKSZ; i++)
+                if (blk[i])
+                    c[n++] = blk[i];
+            locate_scan(src, seen, c, n);
+            free(c);
+        }
+        else if (locate_key(l, le, "if", true)
+                || locate_key(l, le, "menu", true))
+        {
+            mb = 'm' == *l;
+            if (depth < LBLOCKSZ)
+                blk[depth] = mb ? NULL : locate_text(l + 2, le);
+            depth++;
+        }
+        else if (locate_key(l, le, "endif", false)
+                || locate_key(l, le, "endmenu", false))
+        {
+            mb = false;
+            if (depth && --depth < LBLOCKSZ)
+                free(blk[depth]);
+        }
+        else if (mb && locate_key(t, le, "depends on ", false))
+        {
+            char *x = locate_text(t + 11, le);
+            if (depth - 1 < LBLOCKSZ)
+                blk[depth - 1] = append(blk[depth - 1], x);
+            free(x);
+        }
+        else
+        {
+            if (locate_key(l, le, "choice", false)
+                || locate_key(t, le, "config", true)
+                || locate_key(t, le, "menuconfig", true))
+                mb = false;
+            locate_config(l, le, f);
+        }
+        free(src);
+        l = nl ? nl + 1 : end;
+    }
+
+    while (depth)
+        if (--depth < LBLOCKSZ)
+            free(blk[depth]);
+    return;
+}
+
+static bool
+locate_load(const char *path)
+{
+    struct stat st;
+    char *line = NULL;
+    size_t lsz = 0;
+    bool valid = true;
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+        return false;
+    valid = getline(&line, &lsz, f) > 0 && !strcmp(line, LVERSION "\n");
+    while (valid && getline(&line, &lsz, f) > 0)
+    {
+        int64_t mtime, size;
+        uint32_t file;
+        int n = 0;
+
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "F\t%" SCNd64 "\t%" SCNd64 "\t%n", &mtime, &size, &n)
+            == 2 && n)
+        {
+            valid = !fstatat(ck->srcfd, line + n, &st, 0)
+                    && st.st_mtime == mtime
+                    && st.st_size == size;
+            locate_file(strdup(line + n), mtime, size);
+        }
+        else if (sscanf(line, "S\t%" SCNu32 "\t%n", &file, &n) == 1 && n
+                && file < lx.nfile)
+            locate_sym(strdup(line + n), file);
+        else if (!strncmp(line, "B\t", 2) && lx.nfile)
+            locate_cond(strdup(line + 2));
+        else if (!strncmp(line, "A\t", 2) && lx.nfile
+                && lx.file[lx.nfile - 1].ncond)
+        {
+            lFile *t = &lx.file[lx.nfile - 1];
+            t->cond[t->ncond - 1] = append(t->cond[t->ncond - 1], line + 2);
+        }
+        else
+            valid = false;
+    }
+    free(line);
+    fclose(f);
+
+    return valid && lx.nfile;
+}
+
+static void
+locate_save(const char *path)
+{
+    char tmp[1100];
+
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    FILE *f = fopen(tmp, "w");
+    if (!f)
+        return;
+
+    fprintf(f, "%s\n", LVERSION);
+    for (uint32_t i = 0; i < lx.nfile; i++)
+    {
+        fprintf(f, "F\t%" PRId64 "\t%" PRId64 "\t%s\n",
+                        lx.file[i].mtime, lx.file[i].size, lx.file[i].fname);
+        /* a condition of several 'depends on' lines: one B, then A lines */
+        for (uint16_t k = 0; k < lx.file[i].ncond; k++)
+        {
+            const char *c = lx.file[i].cond[k], *d;
+            fputs("B\t", f);
+            while ((d = strstr(c, ";\n\t")))
+            {
+                fprintf(f, "%.*s\nA\t", (int)(d - c), c);
+                c = d + 3;
+            }
+            fprintf(f, "%s\n", c);
+        }
+    }
+    for (uint32_t i = 0; i < lx.nsym; i++)
+        fprintf(f, "S\t%" PRIu32 "\t%s\n", lx.sym[i].file, lx.sym[i].name);
+
+    if (fclose(f) || rename(tmp, path))
+        unlink(tmp);
+    return;
+}
+
+static void
+locate_init(void)
+{
+    if (!(ck->lindex = calloc(1, sizeof(lIndex))))
+        failx("could not allocate symbol index");
+    if (!hcreate_r(LOCATESZ, &lx.h))
+        failx("could not create symbol index");
+
+    return;
+}
+
+void
+locate_free(void)
+{
+    if (!ck->lindex)
+        return;
+
+    for (uint32_t i = 0; i < lx.nfile; i++)
+    {
+        free(lx.file[i].fname);
+        for (uint16_t k = 0; k < lx.file[i].ncond; k++)
+            free(lx.file[i].cond[k]);
+        free(lx.file[i].cond);
+    }
+    for (uint32_t i = 0; i < lx.nsym; i++)
+        free(lx.sym[i].name);
+    free(lx.file);
+    free(lx.sym);
+    hdestroy_r(&lx.h);
+    free(ck->lindex);
+    ck->lindex = NULL;
+
+    return;
+}
+
+/* parse files defining a symbol, in tree order */
+static void
+locate_parse(const char *name)
+{
+    ENTRY e = { (char *)name, NULL }, *r;
+
+    if (!hsearch_r(e, FIND, &r, &lx.h) || !r)
+        return;
+    for (uint32_t i = (uintptr_t)r->data; i; i = lx.sym[i - 1].next)
+    {
+        const lFile *f = &lx.file[lx.sym[i - 1].file];
+        for (uint16_t k = 0; k < f->ncond; k++)
+            block_push(strdup(f->cond[k]));
+        parse_kconfig(f->fname);
+        for (uint16_t k = 0; k < f->ncond; k++)
+            block_pop();
+    }
+
+    return;
+}
+
+/* parse files defining the symbols of an expression */
+static void
+locate_expr(const char *expr)
+{
+    char *x = expr ? strdup(expr) : NULL;
+
+    for (char *p, *s = x ? strtok_r(x, " \t\n;!=<>()&|\"'", &p) : NULL; s;
+            s = strtok_r(NULL, " \t\n;!=<>()&|\"'", &p))
+        locate_parse(s);
+
+    free(x);
+    return;
+}
+
+/* load the symbol index of the tree in use, or build and save it */
+static int
+locate_index(void)
+{
+    int r = 0;
+    char path[1040] = "", name[32];
+    uint64_t h = fnv(FNVBASIS, gstr[ISRCT], strlen(gstr[ISRCT]) + 1);
+
+    h = fnv(h, gstr[IARCH], strlen(gstr[IARCH]));
+    snprintf(name, sizeof(name), "symbols-%016" PRIx64, h);
+    locate_init();
+    if (cache_file(path, sizeof(path), name) || !locate_load(path))
+    {
+        struct hsearch_data seen;
+
+        locate_free();
+        locate_init();
+        memset(&seen, 0, sizeof(seen));
+        if (!hcreate_r(HASHSZ, &seen))
+            failx("could not create symbol index");
+
+        prefetch_start("Kconfig");
+        locate_scan("Kconfig", &seen, NULL, 0);
+        hdestroy_r(&seen);
+        if (!lx.nfile)
+        {
+            diagx(DIAG_ERROR, NULL, "could not open file: %s/%s",
+                                                gstr[ISRCT], "Kconfig");
+            r = -1;
+        }
+        else if (*path)
+            locate_save(path);
+    }
+    else if (opts & OUT_VERBOSE)
+        warnx("using symbol index %s", path);
+
+    return r;
+}
+
+/* load the Kconfig files needed to show option 'sym' */
+int
+locate_kconfigs(const char *sym)
+{
+    int r = locate_index();
+
+    /* the option, then options of its 'depends on' and block conditions */
+    locate_parse(sym);
+    cNode *c = hsearch_kconfigs(sym);
+    if (c && c->type == CENTRY)
+    {
+        cEntry *t = c->data;
+        locate_expr(t->opt_depends);
+        for (bCond *b = t->opt_block; b; b = b->up)
+            locate_expr(b->expr);
+    }
+
+    prefetch_stop();
+    locate_free();
+    return r;
+}
+
+/* symbols of tree 'srcdir' beginning with 'prefix', from the index */
+int
+locate_complete(const char *srcdir, const char *prefix, ck_name_fn fn,
+                                                                void *arg)
+{
+    int r = -1;
+
+    if (srcdir_open(srcdir))
+        return r;
+
+    if (!(r = locate_index()))
+    {
+        const char **name = malloc((lx.nsym + 1) * sizeof(char *));
+        if (!name)
+            failx("could not allocate symbol names");
+        for (uint32_t i = 0; i < lx.nsym; i++)
+            name[i] = lx.sym[i].name;
+
+        pIndex *x = prefix_build(name, lx.nsym);
+        prefix_each(x, prefix, fn, arg);
+        prefix_free(x);
+        free(name);
+    }
+    prefetch_stop();
+    locate_free();
+
+    return r;
+}
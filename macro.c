@@ -0,0 +1,549 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "configk.h"
+
+/*
+ * $(...) macros: the Kconfig built-in functions and the toolchain probes
+ * of scripts/Kconfig.include are evaluated here. Commands run by a probe
+ * are memoized by the toolchain identity, the source tree and the expanded
+ * command line, in memory and in a cache file which is shared by later
+ * runs. Runs at the same time lock the file while they read, compact or
+ * append to it. Commands run in the source tree with a 'cd' of their
+ * shell, the cwd of the process is not changed. The memory cache is kept
+ * in the handle.
+ */
+
+#define MCACHESZ 4096
+#define MARGSZ 8
+
+struct m_cache
+{
+    struct hsearch_data h;
+    char *toolid;
+    int fd;             /* cache file, results are appended to it */
+    char **kv;          /* keys and results entered, see macro_free() */
+    uint32_t nkv;
+};
+
+/* variables used by Kconfig.include probes */
+static const char *
+macro_var(const char *name)
+{
+    const char *v = getenv(name);
+
+    if (v)
+        return v;
+    if (!strcmp(name, "CC") || !strcmp(name, "HOSTCC"))
+        return "gcc";
+    if (!strcmp(name, "LD"))
+        return "ld";
+    if (!strcmp(name, "srctree"))
+        return gstr[ISRCT] ? gstr[ISRCT] : ".";
+    if (!strcmp(name, "ARCH") || !strcmp(name, "SRCARCH"))
+        return gstr[IARCH];
+    if (!strcmp(name, "comma"))
+        return ",";
+
+    return "";
+}
+
+/* identity of a tool: its path, modification time and size */
+static void
+macro_tool(char *id, size_t sz, const char *var)
+{
+    struct stat s;
+    char path[1024];
+    const char *tool = macro_var(var);
+    size_t n = strcspn(tool, " \t");
+    char *dirs = strdup(getenv("PATH") ? getenv("PATH") : "/usr/bin");
+
+    snprintf(id, sz, "%s=%.*s", var, (int)n, tool);
+    for (char *p, *d = strtok_r(dirs, ":", &p); d; d = strtok_r(NULL, ":", &p))
+    {
+        if (strchr(tool, '/') && d != dirs)
+            break;
+        if (strchr(tool, '/'))
+            snprintf(path, sizeof(path), "%.*s", (int)n, tool);
+        else
+            snprintf(path, sizeof(path), "%s/%.*s", d, (int)n, tool);
+        if (!stat(path, &s))
+        {
+            snprintf(id, sz, "%s=%s:%ld:%ld", var, path,
+                                (long)s.st_mtime, (long)s.st_size);
+            break;
+        }
+    }
+
+    free(dirs);
+    return;
+}
+
+/* keep an entered key and result, the table does not free them */
+static void
+macro_keep(const ENTRY *e)
+{
+    mCache *m = ck->mcache;
+
+    if (m->nkv % 256 == 0)
+    {
+        m->kv = realloc(m->kv, (m->nkv + 256) * sizeof(char *));
+        if (!m->kv)
+            failx("could not allocate macro cache");
+    }
+    m->kv[m->nkv++] = e->key;
+    m->kv[m->nkv++] = e->data;
+
+    return;
+}
+
+/*
+ * A tool identity 'part' of 'len' bytes of a cache line, same tool as 'id'
+ * of the one in use but another modification time or size: an older build.
+ */
+static bool
+macro_stale(const char *part, size_t len, const char *id)
+{
+    const char *c = strrchr(id, ':');
+
+    if (c)
+        while (c > id && ':' != *--c)
+            ;
+    if (!c || ':' != *c)
+        return false;
+
+    size_t n = c - id + 1;
+    return len >= n && !strncmp(part, id, n)
+            && (len != strlen(id) || strncmp(part, id, len));
+}
+
+/*
+ * Rewrite the cache file with the lines loaded, dropping duplicate lines
+ * and the ones of older builds of the tools, so that it does not grow with
+ * every toolchain update. It is rewritten in place, under the lock taken
+ * to read it: a run which holds it open appends to the same file.
+ */
+static void
+macro_compact(int fd, char **line, uint32_t n)
+{
+    int wfd = dup(fd);
+    FILE *f = wfd < 0 ? NULL : fdopen(wfd, "a");
+
+    if (!f)
+    {
+        if (wfd >= 0)
+            close(wfd);
+        return;
+    }
+    if (ftruncate(fd, 0))
+    {
+        fclose(f);
+        return;
+    }
+
+    /* each line is kept as its key and result */
+    for (uint32_t i = 0; i < n; i++)
+        fprintf(f, "%s\t%s\n", line[i], line[i] + strlen(line[i]) + 1);
+    fclose(f);
+
+    return;
+}
+
+static void
+macro_init(void)
+{
+    char id[2][1280], path[1040];
+    mCache *m = calloc(1, sizeof(mCache));
+
+    if (!m || !hcreate_r(MCACHESZ, &m->h))
+        failx("could not create macro cache");
+    m->fd = -1;
+    ck->mcache = m;
+
+    macro_tool(id[0], sizeof(id[0]), "CC");
+    macro_tool(id[1], sizeof(id[1]), "LD");
+    m->toolid = calloc(strlen(id[0]) + strlen(id[1]) + 2, sizeof(char));
+    if (!m->toolid)
+        failx("could not allocate macro cache");
+    sprintf(m->toolid, "%s;%s", id[0], id[1]);
+
+    if (cache_file(path, sizeof(path), "macros"))
+        return;
+    m->fd = open(path, O_RDWR|O_APPEND|O_CREAT|O_CLOEXEC, 0644);
+    if (m->fd < 0 || flock(m->fd, LOCK_EX))
+        return;
+
+    int rfd = dup(m->fd);
+    FILE *f = rfd < 0 ? NULL : fdopen(rfd, "r");
+    if (f)
+    {
+        char *line = NULL, **kept = NULL;
+        size_t lsz = 0;
+        size_t tl = strlen(m->toolid);
+        uint32_t nline = 0, nkept = 0;
+        struct hsearch_data seen;
+
+        memset(&seen, 0, sizeof(seen));
+        if (!hcreate_r(MCACHESZ, &seen))
+            failx("could not create macro cache");
+        while (getline(&line, &lsz, f) > 0)
+        {
+            ENTRY e, *r;
+            line[strcspn(line, "\n")] = '\0';
+            nline++;
+
+            char *cmd = line + strcspn(line, "\t"), *v;
+            size_t cl = strcspn(line, ";\t");
+            if (!*cmd || !(v = strchr(cmd + 1, '\t'))
+                || macro_stale(line, cl, id[0])
+                || (';' == line[cl] && macro_stale(line + cl + 1,
+                                        cmd - line - cl - 1, id[1])))
+                continue;
+
+            /* a line seen before, keyed by its tools and command */
+            *v++ = '\0';
+            e.key = line;
+            e.data = NULL;
+            if (hsearch_r(e, FIND, &r, &seen) && r)
+                continue;
+            if (nkept % 256 == 0)
+            {
+                kept = realloc(kept, (nkept + 256) * sizeof(char *));
+                if (!kept)
+                    failx("could not allocate macro cache");
+            }
+            size_t kl = strlen(line) + 1;
+            if (!(kept[nkept] = malloc(kl + strlen(v) + 1)))
+                failx("could not allocate macro cache");
+            memcpy(kept[nkept], line, kl);
+            strcpy(kept[nkept] + kl, v);
+            e.key = kept[nkept++];
+            hsearch_r(e, ENTER, &r, &seen);
+
+            if (cmd - line != (ssize_t)tl || strncmp(line, m->toolid, tl))
+                continue;
+            e.key = strdup(cmd + 1);
+            e.data = strdup(v);
+            if (!hsearch_r(e, ENTER, &r, &m->h) || r->key != e.key)
+            {
+                free(e.key);
+                free(e.data);
+            }
+            else
+                macro_keep(&e);
+        }
+        free(line);
+        fclose(f);
+        hdestroy_r(&seen);
+
+        if (nkept < nline)
+            macro_compact(m->fd, kept, nkept);
+        for (uint32_t i = 0; i < nkept; i++)
+            free(kept[i]);
+        free(kept);
+    }
+    else if (rfd >= 0)
+        close(rfd);
+    flock(m->fd, LOCK_UN);
+
+    return;
+}
+
+/* shell line of 'cmd' run in the source tree, output redirected by 'redir' */
+static char *
+macro_sh(const char *cmd, const char *redir)
+{
+    size_t osz = 0;
+    char *out = NULL;
+    FILE *o = open_memstream(&out, &osz);
+
+    if (!o)
+        failx("could not allocate macro command");
+    fputs("cd '", o);
+    for (const char *d = gstr[ISRCT] ? gstr[ISRCT] : "."; *d; d++)
+    {
+        if ('\'' == *d)
+            fputs("'\\''", o);
+        else
+            fputc(*d, o);
+    }
+    fprintf(o, "' && ( %s )%s", cmd, redir);
+    fclose(o);
+
+    return out;
+}
+
+/*
+ * Run a command with 'sh -c': 's' mode returns its output with new lines
+ * turned into spaces, 'x' mode returns "y" if it exits with 0, else "n".
+ */
+static char *
+macro_run(char mode, const char *cmd)
+{
+    ENTRY e, *r = NULL;
+    const char *srct = gstr[ISRCT] ? gstr[ISRCT] : ".";
+    char *key = calloc(strlen(srct) + strlen(cmd) + 4, sizeof(char));
+
+    if (!key)
+        failx("could not allocate macro command");
+    if (!ck->mcache)
+        macro_init();
+    mCache *m = ck->mcache;
+
+    /* a command of one tree may give another result in another tree */
+    sprintf(key, "%c:%s:%s", mode, srct, cmd);
+    for (char *k = key; *k; k++)
+        *k = ('\t' == *k || '\n' == *k) ? ' ' : *k;
+    e.key = key;
+    if (hsearch_r(e, FIND, &r, &m->h) && r)
+    {
+        free(key);
+        return strdup(r->data);
+    }
+
+    if (opts & OUT_VERBOSE)
+        fprintf(stderr, "probe: %s\n", cmd);
+
+    char *out = NULL;
+    size_t osz = 0;
+    if ('x' == mode)
+    {
+        char *sh = macro_sh(cmd, " >/dev/null 2>&1");
+        out = strdup(system(sh) ? "n" : "y");
+        free(sh);
+    }
+    else
+    {
+        char *sh = macro_sh(cmd, "");
+        FILE *p = popen(sh, "r");
+        FILE *o = open_memstream(&out, &osz);
+        if (p && o)
+        {
+            int ch;
+            while ((ch = fgetc(p)) != EOF)
+                fputc('\n' == ch ? ' ' : ch, o);
+        }
+        if (o)
+            fclose(o);
+        if (p)
+            pclose(p);
+        free(sh);
+        while (osz && ' ' == out[osz - 1])
+            out[--osz] = '\0';
+    }
+    if (!out)
+        out = strdup("");
+
+    /* a line is written whole while other runs read or append */
+    if (m->fd >= 0 && !flock(m->fd, LOCK_EX))
+    {
+        dprintf(m->fd, "%s\t%s\t%s\n", m->toolid, key, out);
+        flock(m->fd, LOCK_UN);
+    }
+    e.data = strdup(out);
+    if (hsearch_r(e, ENTER, &r, &m->h))
+        macro_keep(&e);
+    else
+    {
+        free(key);
+        free(e.data);
+    }
+
+    return out;
+}
+
+/* expand all $(...) references in a string */
+static char *
+macro_expand(const char *s)
+{
+    size_t osz = 0;
+    char *out = NULL;
+    FILE *o = open_memstream(&out, &osz);
+
+    if (!o)
+        failx("could not allocate macro expansion");
+    while (*s)
+    {
+        if (*s != '$' || s[1] != '(')
+        {
+            fputc(*s++, o);
+            continue;
+        }
+
+        uint16_t n = 1;
+        const char *e = s + 2;
+        for (; *e && n; e++)
+            n += ('(' == *e) - (')' == *e);
+
+        char *in = strndup(s + 2, e - s - 2 - !n);
+        char *v = macro_eval(in);
+        fputs(v, o);
+        free(v);
+        free(in);
+        s = e;
+    }
+    fclose(o);
+
+    return out;
+}
+
+static char *
+macro_fmt(const char *f, char **arg, uint8_t narg)
+{
+    size_t osz = 0;
+    char *out = NULL;
+    FILE *o = open_memstream(&out, &osz);
+
+    if (!o)
+        failx("could not allocate macro expansion");
+    for (; *f; f++)
+    {
+        if ('%' == *f && isdigit((uint8_t)f[1]))
+        {
+            uint8_t i = *++f - '0';
+            fputs(i < narg ? arg[i] : "", o);
+        }
+        else
+            fputc(*f, o);
+    }
+    fclose(o);
+
+    return out;
+}
+
+/*
+ * Kconfig.include probes, %0 is the function name and %N its arguments.
+ * Functions which are not listed expand to an empty string.
+ */
+static const struct
+{
+    const char *name;
+    char mode;
+    const char *cmd;
+} probes[] =
+{
+    { "cc-option", 'x', "$(CC) -Werror $(CLANG_FLAGS) %1 -S -x c /dev/null"
+                                                        " -o /dev/null" },
+    { "ld-option", 'x', "$(LD) -v %1" },
+    { "as-option", 'x', "$(CC) -Werror $(CLANG_FLAGS) %1 -c"
+                        " -x assembler-with-cpp /dev/null -o /dev/null" },
+    { "as-instr", 'x', "printf \"%b\\n\" \"%1\" | $(CC) -Werror $(CLANG_FLAGS)"
+                " %2 -Wa,--fatal-warnings -c -x assembler-with-cpp"
+                " -o /dev/null -" },
+    { "cc-option-bit", 'x', "$(CC) -Werror %1 -S -x c /dev/null -o /dev/null" },
+    { NULL, 0, NULL }
+};
+
+/* evaluate a "name,arg,..." $(...) macro body, caller frees the result */
+char *
+macro_eval(const char *body)
+{
+    uint8_t narg = 0;
+    char *arg[MARGSZ], *r = NULL;
+    const char *s = body;
+
+    /* split at top level commas, arguments are expanded before the call */
+    while (narg < MARGSZ)
+    {
+        uint16_t n = 0;
+        const char *e = s;
+        for (; *e && (n || ',' != *e); e++)
+            n += ('(' == *e) - (')' == *e);
+
+        char *a = strndup(s, e - s);
+        arg[narg++] = macro_expand(a);
+        free(a);
+        if (!*e)
+            break;
+        s = e + 1;
+    }
+
+    char *f = arg[0] + strspn(arg[0], " \t");
+    f[strcspn(f, " \t")] = '\0';
+    if (1 == narg)
+        r = strdup(macro_var(f));
+    else if (!strcmp(f, "shell"))
+        r = macro_run('s', arg[1]);
+    else if (!strcmp(f, "success") || !strcmp(f, "failure"))
+    {
+        r = macro_run('x', arg[1]);
+        if ('f' == *f)
+            *r = ('y' == *r) ? 'n' : 'y';
+    }
+    else if (!strcmp(f, "if-success") && narg > 3)
+    {
+        char *x = macro_run('x', arg[1]);
+        r = strdup('y' == *x ? arg[2] : arg[3]);
+        free(x);
+    }
+    else
+    {
+        for (uint8_t i = 0; probes[i].name && !r; i++)
+        {
+            if (strcmp(f, probes[i].name))
+                continue;
+
+            char *c = macro_fmt(probes[i].cmd, arg, narg);
+            char *cmd = macro_expand(c);
+            r = macro_run(probes[i].mode, cmd);
+            if (!strcmp(f, "cc-option-bit"))
+            {
+                char *b = strdup('y' == *r ? arg[1] : "");
+                free(r);
+                r = b;
+            }
+            free(cmd);
+            free(c);
+        }
+        if (!r && (opts & OUT_VERBOSE))
+            fprintf(stderr, "macro: %s: unknown function\n", f);
+    }
+
+    for (uint8_t i = 0; i < narg; i++)
+        free(arg[i]);
+    return r ? r : strdup("");
+}
+
+uint32_t
+macro_free(void)
+{
+    uint32_t tmem = 0;
+    mCache *m = ck->mcache;
+
+    if (!m)
+        return tmem;
+
+    for (uint32_t i = 0; i < m->nkv; i++)
+    {
+        tmem += strlen(m->kv[i]);
+        free(m->kv[i]);
+    }
+    free(m->kv);
+    free(m->toolid);
+    if (m->fd >= 0)
+        close(m->fd);
+    hdestroy_r(&m->h);
+    free(m);
+    ck->mcache = NULL;
+
+    return tmem;
+}
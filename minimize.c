@@ -0,0 +1,183 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <ctype.h>
+#include "configk.h"
+#include "report.h"
+
+/*
+ * --minimize: reduce a checked configuration to a defconfig fragment. An
+ * option is written only if its value differs from the one its 'default'
+ * attribute and the 'select' and 'imply' attributes of enabled options give
+ * it, with the values of the rest of the configuration. Options without a
+ * prompt or with dependencies not met can not be set by the user and are
+ * not written; of a choice only a member other than its default is.
+ */
+
+enum
+{
+    MNONE = 0x0,
+    MMOD = 0x1,
+    MYES = 0x2
+}; /* tristate levels */
+
+typedef struct
+{
+    uint8_t *sel;       /* level selected by enabled options, by opt_id */
+    uint8_t *imp;       /* level implied by enabled options */
+    uint8_t *level;     /* sel or imp, for minimize_cascade() */
+} mRun; /* minimize_cascade() finds it in the handle */
+
+extern int8_t eescans(uint8_t, const char *, char **);
+
+static uint8_t
+minimize_level(const char *v)
+{
+    if (!v || 'n' == tolower(*v))
+        return MNONE;
+
+    return 'm' == tolower(*v) ? MMOD : MYES;
+}
+
+/* select/imply of an enabled option, see eval_expression() */
+static int8_t
+minimize_cascade(const char *sopt, uint8_t status, char *val)
+{
+    (void)status;
+    mRun *x = ck->cascade_arg;
+    cNode *c = hsearch_kconfigs(sopt);
+    if (!c || c->type != CENTRY)
+        return 0;
+
+    uint32_t id = ((cEntry *)c->data)->opt_id;
+    uint8_t l = (val && 'm' == tolower(*val)) ? MMOD : MYES;
+    if (x->level[id] < l)
+        x->level[id] = l;
+
+    return 1;
+}
+
+static void
+minimize_reverse(mRun *x, const sGraph *g)
+{
+    for (uint32_t i = 0; i < g->nsym; i++)
+    {
+        cEntry *t = g->sym[i]->data;
+        if (t->opt_status <= 0 || (!t->opt_select && !t->opt_imply))
+            continue;
+
+        char *val = strdup(t->opt_value);
+        x->level = x->sel;
+        if (t->opt_select)
+            eescans(ENABLE_CONFIG, t->opt_select, &val);
+        x->level = x->imp;
+        if (t->opt_imply)
+            eescans(ENABLE_CONFIG, t->opt_imply, &val);
+        free(val);
+    }
+
+    return;
+}
+
+/* option value differs from the one it gets when a fragment is expanded */
+static bool
+minimize_option(const mRun *x, const cNode *c, const char *cur)
+{
+    cEntry *t = c->data;
+    uint32_t id = t->opt_id;
+    char *def = eval_default(t);
+    bool r;
+
+    if (CBOOL == t->opt_type || CTRISTATE == t->opt_type)
+    {
+        uint8_t l = minimize_level(def);
+        l = l < x->imp[id] ? x->imp[id] : l;
+        l = l < x->sel[id] ? x->sel[id] : l;
+        if (CBOOL == t->opt_type && MMOD == l)
+            l = MYES;
+
+        /* an option selected as 'y' can not be changed */
+        r = MYES != x->sel[id] && minimize_level(cur) != l;
+    }
+    else if (CINT == t->opt_type || CHEX == t->opt_type)
+        r = !def || strtoll(def, NULL, 0) != strtoll(cur, NULL, 0);
+    else
+        r = !def || strcmp(def, cur);
+
+    free(def);
+    return r;
+}
+
+int
+minimize_kconfigs(ck_handle *h)
+{
+    CK_ENTER(h, -1);
+    uint32_t nerrs = h->nerrs;
+    uint32_t n = 0, nset = 0;
+    sGraph *g = graph_build(NULL, NULL);
+
+    mRun x = { calloc(g->nsym + 1, sizeof(uint8_t)),
+                calloc(g->nsym + 1, sizeof(uint8_t)), NULL };
+    if (!x.sel || !x.imp)
+    {
+        free(x.sel);
+        free(x.imp);
+        graph_free(g);
+        failx("could not allocate option levels");
+    }
+
+    int8_t (*cascade)(const char *, uint8_t, char *) = ck->cascade;
+    void *arg = ck->cascade_arg;
+    ck->cascade = minimize_cascade;
+    ck->cascade_arg = &x;
+    minimize_reverse(&x, g);
+    ck->cascade = cascade;
+    ck->cascade_arg = arg;
+
+    for (uint32_t i = 0; i < g->nsym; i++)
+    {
+        cNode *c = g->sym[i];
+        cEntry *t = c->data;
+        if (c->type != CENTRY || !t->opt_status
+            || (t->opt_status < 0 && -CVALNOSET != t->opt_status))
+            continue;
+
+        nset++;
+        bool off = -CVALNOSET == t->opt_status;
+        if (t->opt_group && CBOOL == t->opt_type)
+        {
+            /* choice: the enabled member, unless it is the default */
+            if (off || choice_default(t->opt_group, NULL) == c)
+                continue;
+        }
+        else if (!t->opt_prompt || !check_depends(t->opt_name)
+            || !minimize_option(&x, c, off ? "n" : t->opt_value))
+            continue;
+
+        n++;
+        if (off)
+            printf("# CONFIG_%s is not set\n", t->opt_name);
+        else
+            printf("CONFIG_%s=%s\n", t->opt_name, t->opt_value);
+    }
+    fprintf(stderr, "Options written: %u of %u\n", n, nset);
+
+    free(x.sel);
+    free(x.imp);
+    graph_free(g);
+    return ck_unbind(nerrs != h->nerrs ? -1 : 0);
+}
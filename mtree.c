@@ -0,0 +1,315 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <poll.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "configk.h"
+#include "report.h"
+
+/*
+ * Check of configuration files against several source trees. The flex and
+ * bison scanners are not re-entrant, so each tree is loaded and checked by
+ * a worker process of its own, all of them at once. A worker writes its
+ * problems as 'kind<TAB>option<TAB>message' lines to a pipe. The parent
+ * reads all pipes as they are written and merges the lines in one table,
+ * keyed by kind and option, or kind and message when there is no option,
+ * with the set of trees each one is found in.
+ */
+
+#define MTREESZ 64
+
+typedef struct
+{
+    char *key;          /* kind<TAB>option, or kind<TAB><TAB>message */
+    char *name;         /* option, in key */
+    char *msg;          /* message of the first tree */
+    uint64_t trees;     /* trees it is found in, one bit each */
+} mEntry;
+
+typedef struct
+{
+    mEntry *ent;
+    uint32_t nent;
+    uint32_t entsz;
+    struct hsearch_data h;  /* key => entry index + 1 */
+} mTable; /* problems of all trees */
+
+/* worker: diagnostics of one tree */
+static void
+mtree_diag(const char *kind, const char *opt, const char *msg, void *arg)
+{
+    FILE *fp = arg;
+
+    fprintf(fp, "%s\t%s\t", kind, opt ? opt : "");
+    for (; *msg; msg++)
+        fputc('\n' == *msg || '\t' == *msg ? ' ' : *msg, fp);
+    fputc('\n', fp);
+
+    return;
+}
+
+/* worker: options set with dependencies not met, as tree_display() shows */
+static int
+mtree_depends(ck_handle *h)
+{
+    CK_ENTER(h, -1);
+
+    sGraph *g = graph_build(NULL, NULL);
+    for (uint32_t i = 0; i < g->nsym; i++)
+    {
+        cEntry *t = g->sym[i]->data;
+        if (g->sym[i]->type == CENTRY && t->opt_status
+            && t->opt_status != -CVALNOSET && !check_depends(t->opt_name))
+            diagx(DIAG_DEPENDS, t->opt_name,
+                        "option dependency not met for '%s'", t->opt_name);
+    }
+    graph_free(g);
+
+    return ck_unbind(0);
+}
+
+/* worker: load tree 'srcdir', check the files, report to 'fd' */
+static int
+mtree_worker(const char *arch, const char *srcdir, char *cfiles[],
+                                                    uint16_t ncfiles, int fd)
+{
+    FILE *fp = fdopen(fd, "w");
+    if (!fp)
+        return 1;
+
+    ck_handle *h = ck_open(arch);
+    if (!h)
+    {
+        mtree_diag("error", NULL, "could not create configk handle", fp);
+        fclose(fp);
+        return 1;
+    }
+    ck_set_flags(h, ropts & R_VERBOSE ? CK_VERBOSE : 0);
+    ck_set_diag(h, mtree_diag, fp);
+
+    int r = ck_load_tree(h, srcdir);
+    for (uint16_t i = 0; !r && i < ncfiles; i++)
+        r = ck_load_config(h, cfiles[i]);
+    if (!r)
+        r = mtree_depends(h);
+    if (r)
+        mtree_diag("error", NULL, ck_error(h), fp);
+
+    fclose(fp);
+    return !!r;
+}
+
+/* parent: add one worker line of tree 'n' */
+static void
+mtree_add(mTable *mt, char *line, uint16_t n)
+{
+    ENTRY e, *r;
+    char *msg, *name = strchr(line, '\t');
+
+    if (!name || !(msg = strchr(name + 1, '\t')))
+        return;
+    /* problems without an option are told apart by their message */
+    if (msg > name + 1)
+        *msg = '\0';
+    msg++;
+
+    e.key = line;
+    if (hsearch_r(e, FIND, &r, &mt->h) && r)
+    {
+        mt->ent[(uintptr_t)r->data - 1].trees |= 1ULL << n;
+        return;
+    }
+
+    if (mt->nent == mt->entsz)
+    {
+        mt->entsz = mt->entsz ? mt->entsz * 2 : 1024;
+        if (!(mt->ent = realloc(mt->ent, mt->entsz * sizeof(mEntry))))
+            err(-1, "could not allocate tree report");
+    }
+
+    mEntry *m = &mt->ent[mt->nent];
+    m->key = strdup(line);
+    m->name = m->key + (name - line) + 1;
+    m->msg = strdup(msg);
+    m->trees = 1ULL << n;
+
+    e.key = m->key;
+    e.data = (void *)(uintptr_t)(mt->nent + 1);
+    if (!m->key || !m->msg || !hsearch_r(e, ENTER, &r, &mt->h))
+        err(-1, "could not hash tree report entry");
+    mt->nent++;
+
+    return;
+}
+
+/* parent: add the complete lines read from worker 'n', keep the rest */
+static void
+mtree_lines(mTable *mt, char *buf, size_t *len, uint16_t n)
+{
+    char *p = buf, *nl;
+
+    while ((nl = memchr(p, '\n', *len - (p - buf))))
+    {
+        *nl = '\0';
+        mtree_add(mt, p, n);
+        p = nl + 1;
+    }
+    *len -= p - buf;
+    memmove(buf, p, *len);
+
+    return;
+}
+
+static int
+mtree_cmp(const void *a, const void *b)
+{
+    return strcmp(((const mEntry *)a)->key, ((const mEntry *)b)->key);
+}
+
+static void
+mtree_report(mTable *mt, char *trees[], uint16_t ntree)
+{
+    qsort(mt->ent, mt->nent, sizeof(mEntry), mtree_cmp);
+    for (uint32_t i = 0; i < mt->nent; i++)
+    {
+        mEntry *m = &mt->ent[i];
+        const char *in[MTREESZ];
+        uint16_t nin = 0;
+
+        for (uint16_t k = 0; k < ntree; k++)
+            if (m->trees & (1ULL << k))
+                in[nin++] = trees[k];
+
+        m->name[-1] = '\0';
+        if ('\t' == *m->name)
+            *m->name = '\0';
+        if (ropts & R_JSON)
+        {
+            json_mtree(m->key, m->name, m->msg, in, nin);
+            continue;
+        }
+
+        printf("%-8s %s:", m->key, *m->name ? m->name : m->msg);
+        if (nin == ntree && ntree > 1)
+            printf(" all trees");
+        else
+            for (uint16_t k = 0; k < nin; k++)
+                printf(" %s", in[k]);
+        putchar('\n');
+    }
+    if (!(ropts & R_JSON))
+        printf("Source trees: %u, problems: %u\n", ntree, mt->nent);
+
+    return;
+}
+
+/*
+ * Check 'cfiles', merged in this order, against each of 'trees' for
+ * 'arch'. Returns the number of workers which failed.
+ */
+int
+mtree_kconfigs(const char *arch, char *trees[], uint16_t ntree,
+                                        char *cfiles[], uint16_t ncfiles)
+{
+    struct pollfd pfd[MTREESZ];
+    char *buf[MTREESZ];
+    size_t len[MTREESZ], bsz[MTREESZ];
+    pid_t pid[MTREESZ];
+    uint16_t nfail = 0, nopen = 0;
+
+    mTable mt = { NULL, 0, 0, { 0 } };
+
+    if (ntree > MTREESZ)
+        errx(-1, "at most %u source trees can be checked", MTREESZ);
+    /* problems of all trees, more than the options of one */
+    if (!hcreate_r(4 * HASHSZ, &mt.h))
+        err(-1, "could not create tree report");
+
+    fflush(stdout);
+    fflush(stderr);
+    for (uint16_t n = 0; n < ntree; n++)
+    {
+        int p[2];
+        if (pipe(p) < 0 || (pid[n] = fork()) < 0)
+            err(-1, "could not start a worker process");
+        if (!pid[n])
+        {
+            close(p[0]);
+            for (uint16_t k = 0; k < n; k++)
+                close(pfd[k].fd);
+            _exit(mtree_worker(arch, trees[n], cfiles, ncfiles, p[1]));
+        }
+
+        close(p[1]);
+        pfd[n] = (struct pollfd){ p[0], POLLIN, 0 };
+        buf[n] = NULL;
+        len[n] = bsz[n] = 0;
+        nopen++;
+    }
+
+    /* read the pipes as workers write them, so that none of them blocks */
+    while (nopen)
+    {
+        if (poll(pfd, ntree, -1) < 0)
+            continue;
+        for (uint16_t n = 0; n < ntree; n++)
+        {
+            if (pfd[n].fd < 0 || !pfd[n].revents)
+                continue;
+            if (len[n] + 4096 > bsz[n])
+            {
+                bsz[n] = bsz[n] ? bsz[n] * 2 : 65536;
+                if (!(buf[n] = realloc(buf[n], bsz[n])))
+                    err(-1, "could not allocate tree report");
+            }
+
+            ssize_t r = read(pfd[n].fd, buf[n] + len[n], bsz[n] - len[n]);
+            if (r > 0)
+            {
+                len[n] += r;
+                mtree_lines(&mt, buf[n], &len[n], n);
+                continue;
+            }
+            if (r < 0 && EINTR == errno)
+                continue;
+            close(pfd[n].fd);
+            pfd[n].fd = -1;
+            free(buf[n]);
+            nopen--;
+        }
+    }
+
+    for (uint16_t n = 0; n < ntree; n++)
+    {
+        int st;
+        if (waitpid(pid[n], &st, 0) < 0 || !WIFEXITED(st) || WEXITSTATUS(st))
+            nfail++;
+    }
+    mtree_report(&mt, trees, ntree);
+
+    for (uint32_t i = 0; i < mt.nent; i++)
+    {
+        free(mt.ent[i].key);
+        free(mt.ent[i].msg);
+    }
+    free(mt.ent);
+    hdestroy_r(&mt.h);
+
+    return nfail;
+}
@@ -18,7 +18,7 @@
 %define api.pure full
 %define api.prefix {yy}
 %define parse.error verbose
-%initial-action { t = ch = NULL; chcount = 0; }
+%initial-action { t = ch = NULL; mb = NULL; }
 
 %union {
     int num;
@@ -27,6 +27,7 @@
 
 %token <txt> T_CONFIG T_CONFID
 %token <txt> T_CHOICE T_ENDCHOICE
+%token T_IF T_ENDIF T_MENU T_ENDMENU
 %token <num> T_TYPE T_DEFTYPE
 %token <txt> T_DEFAULT
 %token <txt> T_PROMPT
@@ -45,13 +46,13 @@
 #include <stdio.h>
 #include "configk.h"
 
-extern char *gstr;
 extern char *types[];
 extern int yylex(YYSTYPE *, YYLTYPE *);
 void yyerror(YYLTYPE *, char const *);
 
 cEntry *t, *ch;
-uint16_t chcount;
+bCond *mb;  /* menu block taking 'depends on' lines */
+uint16_t chcount;   /* reset by read_kconfigs() */
 %}
 
 %%
@@ -62,14 +63,24 @@ clist:
     ;
 
 centry:
-    cname    { t = add_new_config($$, CENTRY); }
+    cname    {
+        t = add_new_config($$, CENTRY);
+        t->opt_block = block_curr();
+        mb = NULL;
+        }
     | choice {
         char *chstr = calloc(strlen($$) + 5, sizeof(char));
         sprintf(chstr, "CHOICE%03d", ++chcount);
         t = ch = add_new_config(chstr, CHENTRY);
+        t->opt_block = block_curr();
+        mb = NULL;
         free($$);
         }
     | endchoice { tree_curr_root_up(); ch = NULL; free($$); }
+    | T_IF T_TEXT T_EOL { block_push($2); mb = NULL; }
+    | T_ENDIF T_EOL     { block_pop(); mb = NULL; }
+    | T_MENU T_TEXT T_EOL { mb = block_push(NULL); free($2); }
+    | T_ENDMENU T_EOL   { block_pop(); mb = NULL; }
     | centry cattrs
     | T_EOL
     | error           { yyerrok; }
@@ -152,7 +163,11 @@ attr:
         free($2);
         }
     | T_DEPENDS T_TEXT {
-        t->opt_depends = append(t->opt_depends, $2); free($2);
+        if (mb)
+            block_depends(mb, $2);
+        else
+            t->opt_depends = append(t->opt_depends, $2);
+        free($2);
         }
     | T_SELECT T_TEXT {
         t->opt_select = append(t->opt_select, $2); free($2);
@@ -179,6 +194,7 @@ yyerror(YYLTYPE *loc, char const *serr)
     if (opts & OUT_VERBOSE)
     {
         sEntry *s = (tree_root()->data);
-        warnx("%s: %d: %s", s->fname, loc->last_line, serr);
+        diagx(DIAG_SOURCE, NULL, "%s: %d: %s",
+                                    s->fname, loc->last_line, serr);
     }
 }
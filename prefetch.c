@@ -0,0 +1,400 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "configk.h"
+
+/*
+ * Kconfig file prefetch: while the parser works on a file, reader threads
+ * load the files it sources into memory, following 'source' lines ahead of
+ * the parser. Files are closed as soon as they are read and the parser
+ * scans memory streams, see source_kconfigs() in lexer.l.
+ *
+ * Files sourced by a file are stacked in reverse, so that readers follow
+ * the depth first order of the parser. A file the parser asks for before
+ * any reader took it is read by the parser itself, as is one a reader
+ * could not allocate for: prefetch failures only slow the parser down.
+ */
+
+#define PFTHREADS 8
+
+enum
+{
+    PQUEUED = 0x0,
+    PREAD = 0x1,
+    PDONE = 0x2
+};
+
+typedef struct
+{
+    char *fname;
+    char *buf;
+    size_t len;
+    int64_t mtime;
+    int err;            /* errno of a failed open or read */
+    uint8_t state;
+} pFile; /* prefetched file */
+
+struct p_fetch
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct hsearch_data h;
+    pFile **file;       /* all files, in order of discovery */
+    uint32_t nfile;
+    uint32_t filesz;
+    pFile **stack;      /* files to read */
+    uint32_t top;
+    uint16_t active;    /* readers at work */
+    bool stop;
+    char *arch;
+    int dirfd;          /* source tree of the files */
+    pthread_t tid[PFTHREADS];
+    uint8_t nthread;
+}; /* in the handle while a tree is read, the readers are given it */
+
+/* grow the file lists, returns false if they could not be */
+static bool
+prefetch_grow(pFetch *pf)
+{
+    uint32_t sz = pf->filesz ? pf->filesz * 2 : 1024;
+    pFile **f = realloc(pf->file, sz * sizeof(pFile *));
+
+    if (f)
+        pf->file = f;
+    pFile **s = f ? realloc(pf->stack, sz * sizeof(pFile *)) : NULL;
+    if (!s)
+        return false;
+
+    pf->stack = s;
+    pf->filesz = sz;
+    return true;
+}
+
+/* add a file to read, called with pf->lock held */
+static void
+prefetch_push(pFetch *pf, char *fname)
+{
+    ENTRY e = { fname, NULL }, *r;
+
+    if (hsearch_r(e, FIND, &r, &pf->h) && r)
+    {
+        free(fname);
+        return;
+    }
+
+    /* table full or no memory: the parser reads it when sourced */
+    pFile *p = NULL;
+    if (pf->nfile == pf->filesz && !prefetch_grow(pf))
+    {
+        free(fname);
+        return;
+    }
+    if (!(p = calloc(1, sizeof(pFile))))
+    {
+        free(fname);
+        return;
+    }
+    p->fname = e.key = fname;
+    e.data = p;
+    if (!hsearch_r(e, ENTER, &r, &pf->h))
+    {
+        free(fname);
+        free(p);
+        return;
+    }
+
+    pf->file[pf->nfile++] = p;
+    pf->stack[pf->top++] = p;
+
+    return;
+}
+
+/* 'source' target of a line, same as the s_source rules in lexer.l */
+char *
+prefetch_source(const char *arch, const char *l, const char *e)
+{
+    while (l < e && (' ' == *l || '\t' == *l))
+        l++;
+    if (e - l < 7 || memcmp(l, "source", 6) || (' ' != l[6] && '\t' != l[6]))
+        return NULL;
+
+    char *f = calloc(256, sizeof(char));
+    if (!f)
+        return f;
+
+    size_t n = 0, an = strlen(arch);
+    for (l += 7; l < e && '#' != *l && n < 255; l++)
+    {
+        if ('$' == *l)
+        {
+            const char *s = l + 1 + ('(' == l[1]);
+            if (e - s >= 7 && !memcmp(s, "SRCARCH", 7))
+            {
+                n += snprintf(f + n, 256 - n, "%.*s", (int)an, arch);
+                l = s + 6 + (s + 7 < e && ')' == s[7]);
+                continue;
+            }
+        }
+        if ((*l >= '0' && *l <= '9') || (*l >= 'A' && *l <= 'Z')
+            || (*l >= 'a' && *l <= 'z') || strchr("-/_.", *l))
+            f[n++] = *l;
+    }
+    n = n > 255 ? 255 : n;
+    f[n] = '\0';
+
+    return f;
+}
+
+/* read a file into memory and queue the files it sources */
+static void
+prefetch_read(pFetch *pf, pFile *p)
+{
+    struct stat st;
+    char *buf = NULL;
+    size_t len = 0;
+    int fd = openat(pf->dirfd, p->fname, O_RDONLY|O_CLOEXEC);
+
+    if (fd < 0 || fstat(fd, &st) < 0)
+        p->err = errno;
+    else if (!(buf = malloc(st.st_size + 1)))
+        p->err = ENOMEM;
+    else
+    {
+        ssize_t n;
+        p->mtime = st.st_mtime;
+        while (len < (size_t)st.st_size
+                && (n = read(fd, buf + len, st.st_size - len)) > 0)
+            len += n;
+        buf[len] = '\0';
+    }
+    if (fd >= 0)
+        close(fd);
+
+    uint16_t ns = 0, nssz = 0;
+    char **src = NULL;
+    for (const char *l = buf, *e = buf + len; l && l < e; )
+    {
+        const char *nl = memchr(l, '\n', e - l);
+        char *f = prefetch_source(pf->arch, l, nl ? nl : e);
+        if (f && ns == nssz)
+        {
+            char **t = realloc(src, (nssz ? nssz * 2 : 16) * sizeof(char *));
+            if (t)
+            {
+                src = t;
+                nssz = nssz ? nssz * 2 : 16;
+            }
+        }
+        if (f && ns < nssz)
+            src[ns++] = f;
+        else
+            free(f);
+        l = nl ? nl + 1 : e;
+    }
+
+    pthread_mutex_lock(&pf->lock);
+    p->buf = buf;
+    p->len = len;
+    p->state = PDONE;
+    while (ns)
+        prefetch_push(pf, src[--ns]);
+    pthread_cond_broadcast(&pf->cond);
+    pthread_mutex_unlock(&pf->lock);
+
+    free(src);
+    return;
+}
+
+static void *
+prefetch_thread(void *arg)
+{
+    pFetch *pf = arg;
+
+    pthread_mutex_lock(&pf->lock);
+    while (!pf->stop)
+    {
+        pFile *p = NULL;
+        while (pf->top && !p)
+        {
+            p = pf->stack[--pf->top];
+            p = (PQUEUED == p->state) ? p : NULL;
+        }
+        if (!p)
+        {
+            if (!pf->active)
+                break;
+            pthread_cond_wait(&pf->cond, &pf->lock);
+            continue;
+        }
+
+        p->state = PREAD;
+        pf->active++;
+        pthread_mutex_unlock(&pf->lock);
+        prefetch_read(pf, p);
+        pthread_mutex_lock(&pf->lock);
+        pf->active--;
+    }
+    pthread_cond_broadcast(&pf->cond);
+    pthread_mutex_unlock(&pf->lock);
+
+    return arg;
+}
+
+/* start reading from the top Kconfig file of the tree in use */
+void
+prefetch_start(const char *fname)
+{
+    char *f = strdup(fname);
+    pFetch *pf = calloc(1, sizeof(pFetch));
+
+    /* without a table the parser reads each file itself */
+    if (pf)
+        pf->arch = strdup(gstr[IARCH] ? gstr[IARCH] : "SRCARCH");
+    if (!f || !pf || !pf->arch || !hcreate_r(HASHSZ, &pf->h))
+    {
+        free(f);
+        if (pf)
+            free(pf->arch);
+        free(pf);
+        return;
+    }
+
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->cond, NULL);
+    pf->dirfd = ck->srcfd;
+    ck->prefetch = pf;
+    pthread_mutex_lock(&pf->lock);
+    prefetch_push(pf, f);
+    pthread_mutex_unlock(&pf->lock);
+
+    for (pf->nthread = 0; pf->nthread < PFTHREADS; pf->nthread++)
+        if (pthread_create(&pf->tid[pf->nthread], NULL, prefetch_thread, pf))
+            break;
+
+    return;
+}
+
+/* a read file, taken from the readers if none took it yet */
+static pFile *
+prefetch_get(const char *fname)
+{
+    ENTRY e = { (char *)fname, NULL }, *r;
+    pFetch *pf = ck->prefetch;
+    pFile *p = NULL;
+
+    if (!pf)
+        return p;
+
+    pthread_mutex_lock(&pf->lock);
+    if (hsearch_r(e, FIND, &r, &pf->h) && r)
+        p = r->data;
+    if (p && PQUEUED == p->state)
+    {
+        p->state = PREAD;
+        pf->active++;
+        pthread_mutex_unlock(&pf->lock);
+        prefetch_read(pf, p);
+        pthread_mutex_lock(&pf->lock);
+        pf->active--;
+    }
+    while (p && PDONE != p->state)
+        pthread_cond_wait(&pf->cond, &pf->lock);
+    pthread_mutex_unlock(&pf->lock);
+
+    return p;
+}
+
+/*
+ * Open a Kconfig file for the parser. Returns a stream on the file contents
+ * in memory, or NULL with errno set. It is valid until prefetch_stop().
+ */
+FILE *
+prefetch_open(const char *fname)
+{
+    pFile *p = prefetch_get(fname);
+
+    if (!p)
+    {
+        int fd = openat(ck->srcfd, fname, O_RDONLY|O_CLOEXEC);
+        FILE *f = fd < 0 ? NULL : fdopen(fd, "r");
+        if (fd >= 0 && !f)
+            close(fd);
+        return f;
+    }
+    if (p->err)
+    {
+        errno = p->err;
+        return NULL;
+    }
+
+    return fmemopen(p->buf, p->len, "r");
+}
+
+/* contents of a Kconfig file and its modification time, or NULL */
+const char *
+prefetch_buf(const char *fname, size_t *len, int64_t *mtime)
+{
+    pFile *p = prefetch_get(fname);
+
+    if (!p || p->err)
+        return NULL;
+
+    *len = p->len;
+    *mtime = p->mtime;
+    return p->buf;
+}
+
+/* stop readers and free file contents, streams must be closed by now */
+uint32_t
+prefetch_stop(void)
+{
+    uint32_t tmem = 0;
+    pFetch *pf = ck->prefetch;
+
+    if (!pf)
+        return tmem;
+
+    pthread_mutex_lock(&pf->lock);
+    pf->stop = true;
+    pthread_cond_broadcast(&pf->cond);
+    pthread_mutex_unlock(&pf->lock);
+    while (pf->nthread)
+        pthread_join(pf->tid[--pf->nthread], NULL);
+
+    for (uint32_t i = 0; i < pf->nfile; i++)
+    {
+        tmem += sizeof(pFile) + pf->file[i]->len;
+        free(pf->file[i]->buf);
+        free(pf->file[i]->fname);
+        free(pf->file[i]);
+    }
+    free(pf->file);
+    free(pf->stack);
+    free(pf->arch);
+    hdestroy_r(&pf->h);
+    pthread_mutex_destroy(&pf->lock);
+    pthread_cond_destroy(&pf->cond);
+    free(pf);
+    ck->prefetch = NULL;
+
+    return tmem;
+}
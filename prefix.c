@@ -0,0 +1,214 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <fnmatch.h>
+#include "configk.h"
+
+/*
+ * Prefix index: symbol names in one sorted array. Names with a prefix are
+ * a range of it, found with two binary searches. A glob pattern is matched
+ * with fnmatch(3) over the range of its literal prefix, the part before
+ * the first '*', '?', '[' or '\'. The index of the tree is built by the
+ * first query, a completion without a loaded tree builds one from the
+ * symbol index of locate.c instead, without parsing the tree.
+ */
+
+#define GLOBCHARS "*?[\\"
+
+struct p_index
+{
+    uint32_t n;
+    const char **name;  /* sorted, each one once */
+    void **data;        /* tree node of each name, see prefix_tree() */
+};
+
+static int
+prefix_cmp(const void *a, const void *b)
+{
+    return strcmp(*(const char **)a, *(const char **)b);
+}
+
+static int
+prefix_ncmp(const void *a, const void *b)
+{
+    return strcmp(((cEntry *)(*(cNode **)a)->data)->opt_name,
+                                ((cEntry *)(*(cNode **)b)->data)->opt_name);
+}
+
+static void
+prefix_nodes(pIndex *x, cNode *c)
+{
+    for (; c; c = c->next)
+    {
+        if (c->type == CENTRY)
+        {
+            if (x->n % 1024 == 0)
+            {
+                x->data = realloc(x->data, (x->n + 1024) * sizeof(void *));
+                if (!x->data)
+                    failx("could not allocate prefix index");
+            }
+            x->data[x->n++] = c;
+        }
+        prefix_nodes(x, c->down);
+    }
+
+    return;
+}
+
+/* index of 'n' names, they are not copied and must outlive it */
+pIndex *
+prefix_build(const char *name[], uint32_t n)
+{
+    pIndex *x = calloc(1, sizeof(pIndex));
+    if (!x || !(x->name = malloc((n + 1) * sizeof(char *))))
+        failx("could not allocate prefix index");
+
+    memcpy(x->name, name, n * sizeof(char *));
+    qsort(x->name, n, sizeof(char *), prefix_cmp);
+    for (uint32_t i = 0; i < n; i++)
+        if (!x->n || strcmp(x->name[x->n - 1], x->name[i]))
+            x->name[x->n++] = x->name[i];
+
+    return x;
+}
+
+/* index of the options of the loaded tree, with their nodes */
+static pIndex *
+prefix_tree(void)
+{
+    pIndex *x = ck->pindex;
+    uint32_t n = 0;
+
+    if (x)
+        return x;
+    if (!(x = calloc(1, sizeof(pIndex))))
+        failx("could not allocate prefix index");
+
+    prefix_nodes(x, ck->root_node);
+    qsort(x->data, x->n, sizeof(void *), prefix_ncmp);
+    x->name = malloc((x->n + 1) * sizeof(char *));
+    if (!x->name)
+        failx("could not allocate prefix index");
+    for (uint32_t i = 0; i < x->n; i++)
+    {
+        const char *name = ((cEntry *)((cNode *)x->data[i])->data)->opt_name;
+        if (n && !strcmp(x->name[n - 1], name))
+            continue;
+        x->name[n] = name;
+        x->data[n++] = x->data[i];
+    }
+    x->n = n;
+
+    return ck->pindex = x;
+}
+
+/* names beginning with 'prefix': returns their number, the first in 'at' */
+static uint32_t
+prefix_range(const pIndex *x, const char *prefix, size_t len, uint32_t *at)
+{
+    uint32_t lo = 0, hi = x->n;
+
+    while (lo < hi)
+    {
+        uint32_t m = lo + (hi - lo) / 2;
+        if (strncmp(x->name[m], prefix, len) < 0)
+            lo = m + 1;
+        else
+            hi = m;
+    }
+    *at = lo;
+
+    for (hi = x->n; lo < hi; )
+    {
+        uint32_t m = lo + (hi - lo) / 2;
+        if (strncmp(x->name[m], prefix, len) <= 0)
+            lo = m + 1;
+        else
+            hi = m;
+    }
+
+    return lo - *at;
+}
+
+bool
+prefix_glob(const char *pattern)
+{
+    return !!strpbrk(pattern, GLOBCHARS);
+}
+
+/*
+ * Options of the tree whose name matches glob 'pattern', in name order.
+ * Returns their number, the nodes are stored in '*nodes', which the caller
+ * should free.
+ */
+uint32_t
+prefix_match(const char *pattern, cNode ***nodes)
+{
+    const pIndex *x = prefix_tree();
+    uint32_t at, n = 0;
+    uint32_t k = prefix_range(x, pattern, strcspn(pattern, GLOBCHARS), &at);
+
+    *nodes = malloc((k + 1) * sizeof(cNode *));
+    if (!*nodes)
+        failx("could not allocate prefix matches");
+    for (uint32_t i = at; i < at + k; i++)
+        if (!fnmatch(pattern, x->name[i], 0))
+            (*nodes)[n++] = x->data[i];
+
+    return n;
+}
+
+/*
+ * Call 'fn' on the names of 'x', or of the tree, beginning with 'prefix',
+ * until it returns non-zero. Returns the number of names.
+ */
+uint32_t
+prefix_each(const pIndex *x, const char *prefix, ck_name_fn fn, void *arg)
+{
+    uint32_t at, n;
+
+    if (!x)
+        x = prefix_tree();
+    n = prefix_range(x, prefix, strlen(prefix), &at);
+    for (uint32_t i = at; i < at + n; i++)
+        if (fn(x->name[i], arg))
+            break;
+
+    return n;
+}
+
+uint32_t
+prefix_free(pIndex *x)
+{
+    uint32_t tmem = 0;
+    bool tree = !x;
+
+    if (tree)
+        x = ck->pindex;
+    if (!x)
+        return tmem;
+
+    tmem = x->n * (sizeof(char *) + (x->data ? sizeof(void *) : 0));
+    free(x->name);
+    free(x->data);
+    free(x);
+    if (tree)
+        ck->pindex = NULL;
+
+    return tmem;
+}
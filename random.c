@@ -0,0 +1,463 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/wait.h>
+#include "configk.h"
+#include "report.h"
+
+/*
+ * --randconfig: random configurations. Options are set in tree order: ones
+ * with a prompt and their dependencies met get a random value, others their
+ * default. An enabled option sets the options it selects, one member of a
+ * choice is enabled, int and hex values are taken from their range. Options
+ * whose dependencies are not met by the later values are disabled after.
+ *
+ * Configuration 'k' is generated from the seed 'S + k' alone, so any one
+ * can be generated again with '--randconfig 1 --seed <S + k>'. Workers are
+ * processes forked after the tree is loaded; each one generates every n-th
+ * configuration in a journal transaction and rolls it back.
+ */
+
+enum
+{
+    RNONE = 0x0,
+    RMOD = 0x1,
+    RYES = 0x2
+}; /* tristate levels */
+
+typedef struct
+{
+    const sGraph *g;
+    uint8_t *sel;       /* level selected by enabled options, by opt_id */
+    uint32_t *pend;     /* options to expand selects of, see random_enable() */
+    uint32_t npend;
+    uint32_t mark;
+} rRun; /* state of a worker, random_cascade() finds it in the handle */
+
+extern int8_t eescans(uint8_t, const char *, char **);
+
+/* splitmix64 */
+static uint64_t
+random_next(uint64_t *s)
+{
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint8_t
+random_level(const cEntry *t)
+{
+    if (t->opt_status <= 0 || !t->opt_value || 'n' == tolower(*t->opt_value))
+        return RNONE;
+
+    return 'm' == tolower(*t->opt_value) ? RMOD : RYES;
+}
+
+static void
+random_set(cEntry *t, uint8_t level)
+{
+    if (RNONE == level)
+        toggle_configs(t->opt_name, DISABLE_CONFIG, NULL, false);
+    else
+        set_option(t->opt_name, RMOD == level ? "m" : "y");
+
+    return;
+}
+
+/* select of an enabled option, see eval_expression() */
+static int8_t
+random_cascade(const char *sopt, uint8_t status, char *val)
+{
+    (void)status;
+    rRun *x = ck->cascade_arg;
+    cNode *c = hsearch_kconfigs(sopt);
+    if (!c || c->type != CENTRY)
+        return 0;
+
+    cEntry *t = c->data;
+    uint8_t l = (val && 'm' == tolower(*val)) ? RMOD : RYES;
+    if (CBOOL == t->opt_type)
+        l = RYES;
+    if (x->sel[t->opt_id] >= l)
+        return 1;
+
+    x->sel[t->opt_id] = l;
+    if (random_level(t) < l)
+    {
+        random_set(t, l);
+        t->opt_mark = x->mark;
+        x->pend[x->npend++] = t->opt_id;
+    }
+
+    return 1;
+}
+
+/* level selected by an enabled option, nothing is set */
+static int8_t
+random_select(const char *sopt, uint8_t status, char *val)
+{
+    (void)status;
+    rRun *x = ck->cascade_arg;
+    cNode *c = hsearch_kconfigs(sopt);
+    if (!c || c->type != CENTRY)
+        return 0;
+
+    cEntry *t = c->data;
+    uint8_t l = (val && 'm' == tolower(*val)) ? RMOD : RYES;
+    if (CBOOL == t->opt_type)
+        l = RYES;
+    if (x->sel[t->opt_id] < l)
+        x->sel[t->opt_id] = l;
+
+    return 1;
+}
+
+/* select levels of the options enabled now */
+static void
+random_selects(rRun *x)
+{
+    memset(x->sel, 0, x->g->nsym);
+    ck->cascade = random_select;
+    for (uint32_t i = 0; i < x->g->nsym; i++)
+    {
+        cEntry *t = x->g->sym[i]->data;
+        if (x->g->sym[i]->type != CENTRY || !t->opt_select
+            || t->opt_status <= 0)
+            continue;
+
+        char *val = strdup(t->opt_value);
+        eescans(ENABLE_CONFIG, t->opt_select, &val);
+        free(val);
+    }
+    ck->cascade = random_cascade;
+
+    return;
+}
+
+/* enable an option, then the ones it selects */
+static void
+random_enable(rRun *x, cEntry *t, uint8_t level)
+{
+    random_set(t, level);
+    x->pend[x->npend++] = t->opt_id;
+    while (x->npend)
+    {
+        cEntry *s = x->g->sym[x->pend[--x->npend]]->data;
+        if (!s->opt_select || s->opt_status <= 0)
+            continue;
+
+        char *val = strdup(s->opt_value);
+        eescans(ENABLE_CONFIG, s->opt_select, &val);
+        free(val);
+    }
+
+    return;
+}
+
+static void
+random_choice(rRun *x, const cNode *c, uint64_t *s)
+{
+    chGroup *g = ((cEntry *)c->data)->opt_group;
+    cNode *on = NULL;
+    uint16_t n = 0;
+
+    if (check_depends(((cEntry *)c->data)->opt_name))
+    {
+        for (uint16_t i = 0; i < g->nmember; i++)
+            n += !!check_depends(((cEntry *)g->member[i]->data)->opt_name);
+        n = n ? random_next(s) % n + 1 : 0;
+        for (uint16_t i = 0; i < g->nmember && n; i++)
+            if (check_depends(((cEntry *)g->member[i]->data)->opt_name) && !--n)
+                on = g->member[i];
+    }
+
+    for (uint16_t i = 0; i < g->nmember; i++)
+    {
+        cEntry *t = g->member[i]->data;
+        if (t->opt_mark == x->mark)
+            continue;
+
+        t->opt_mark = x->mark;
+        if (g->member[i] == on)
+            random_enable(x, t, RYES);
+        else
+            random_set(t, RNONE);
+    }
+
+    return;
+}
+
+/* random value of an int or hex option in its range, or its default */
+static char *
+random_number(const cEntry *t, uint64_t *s)
+{
+    long r1, r2;
+    char *v = NULL;
+
+    if (t->opt_range)
+    {
+        char *range = gets_range(t->opt_range);
+        if (2 == sscanf(range, "%li %li", &r1, &r2) && r1 <= r2)
+        {
+            long n = r1 + (long)(random_next(s) % ((uint64_t)(r2 - r1) + 1));
+            v = calloc(24, sizeof(char));
+            snprintf(v, 24, CHEX == t->opt_type ? "0x%lx" : "%ld", n);
+        }
+        free(range);
+    }
+
+    return v ? v : eval_default(t);
+}
+
+static void
+random_option(rRun *x, cEntry *t, uint64_t *s)
+{
+    bool visible = t->opt_prompt && check_depends(t->opt_name);
+    char *v = NULL;
+
+    if (CBOOL == t->opt_type || CTRISTATE == t->opt_type)
+    {
+        uint8_t l = RNONE;
+        if (visible)
+        {
+            cNode *m = hsearch_kconfigs("MODULES");
+            bool mod = CTRISTATE == t->opt_type
+                        && (!m || ((cEntry *)m->data)->opt_status > 0);
+            l = random_next(s) % (mod ? 3 : 2);
+            l = (!mod && l) ? RYES : l;
+        }
+        else if (check_depends(t->opt_name) && (v = eval_default(t)))
+            l = 'n' == tolower(*v) ? RNONE : 'm' == tolower(*v) ? RMOD : RYES;
+
+        free(v);
+        if (l)
+            random_enable(x, t, CBOOL == t->opt_type ? RYES : l);
+        else
+            random_set(t, RNONE);
+        return;
+    }
+
+    if (!check_depends(t->opt_name))
+        v = NULL;
+    else if (visible && (CINT == t->opt_type || CHEX == t->opt_type))
+        v = random_number(t, s);
+    else
+        v = eval_default(t);
+
+    if (v)
+        set_option(t->opt_name, v);
+    else
+        random_set(t, RNONE);
+    free(v);
+
+    return;
+}
+
+/*
+ * Disable options whose dependencies are not met, unless selected. An
+ * option disabled no longer selects, so the select levels are computed
+ * again before each pass, until one changes nothing.
+ */
+static void
+random_fixup(rRun *x)
+{
+    bool changed = true;
+
+    while (changed)
+    {
+        changed = false;
+        random_selects(x);
+        for (uint32_t i = 0; i < x->g->nsym; i++)
+        {
+            cNode *c = x->g->sym[i];
+            cEntry *t = c->data;
+            if (c->type != CENTRY || t->opt_status <= 0 || x->sel[t->opt_id]
+                || check_depends(t->opt_name))
+                continue;
+
+            random_set(t, RNONE);
+            changed = true;
+            if (!t->opt_group || CBOOL != t->opt_type
+                || choice_active(t->opt_group))
+                continue;
+
+            cNode *d = choice_default(t->opt_group, c);
+            if (d)
+                random_enable(x, d->data, RYES);
+        }
+    }
+
+    return;
+}
+
+static void
+random_write(const rRun *x, const char *fname)
+{
+    FILE *fp = fopen(fname, "w");
+
+    if (!fp)
+    {
+        diagx(DIAG_ERROR, NULL,
+                "could not open file: %s: %s", fname, strerror(errno));
+        return;
+    }
+
+    fprintf(fp, "# This file is generated by %s\n", rprog);
+    for (uint32_t i = 0; i < x->g->nsym; i++)
+    {
+        cEntry *t = x->g->sym[i]->data;
+        if (x->g->sym[i]->type != CENTRY)
+            continue;
+        if (t->opt_status > 0)
+            fprintf(fp, "CONFIG_%s=%s\n", t->opt_name, t->opt_value);
+        else
+            fprintf(fp, "# CONFIG_%s is not set\n", t->opt_name);
+    }
+    fclose(fp);
+
+    return;
+}
+
+static void
+random_config(rRun *x, uint64_t seed)
+{
+    uint64_t s = seed;
+
+    journal_begin();
+    x->mark = graph_mark();
+    memset(x->sel, 0, x->g->nsym);
+    x->npend = 0;
+
+    for (uint32_t i = 0; i < x->g->nsym; i++)
+    {
+        cNode *c = x->g->sym[i];
+        cEntry *t = c->data;
+        if (t->opt_mark == x->mark)
+            continue;
+        if (c->type == CHENTRY)
+        {
+            if (t->opt_group)
+                random_choice(x, c, &s);
+            continue;
+        }
+
+        t->opt_mark = x->mark;
+        random_option(x, t, &s);
+    }
+    random_fixup(x);
+
+    char fname[32] = "";
+    if (ropts & R_CONFIG)
+    {
+        snprintf(fname, sizeof(fname), "config-%" PRIu64, seed);
+        random_write(x, fname);
+    }
+    printf("%" PRIu64 " %016" PRIx64 "%s%s\n",
+                        seed, fprint_root(), *fname ? " " : "", fname);
+    fflush(stdout);
+
+    journal_rollback();
+    return;
+}
+
+/*
+ * Generate 'count' configurations from seeds 'seed', 'seed + 1', ... and
+ * show one line for each: its seed and its fingerprint, see fingerprint.c.
+ * With --config each one is also written to a 'config-<seed>' file.
+ */
+int
+random_kconfigs(ck_handle *h, const char *count, const char *seed)
+{
+    CK_ENTER(h, -1);
+    uint32_t nerrs = h->nerrs;
+    char *e;
+    uint64_t s = seed ? strtoull(seed, &e, 0) : (uint64_t)time(NULL);
+    uint32_t n = strtoul(count, NULL, 0);
+
+    if (!n || (seed && *e))
+    {
+        diagx(DIAG_ERROR, NULL, "invalid --randconfig count or --seed");
+        return ck_unbind(-1);
+    }
+    if (!seed)
+        fprintf(stderr, "Seed: %" PRIu64 "\n", s);
+
+    sGraph *g = graph_build(NULL, NULL);
+    rRun x = { g, calloc(g->nsym + 1, sizeof(uint8_t)), NULL, 0, 0 };
+    /* an option is pushed when its level is raised: twice at most */
+    x.pend = calloc(2 * g->nsym + 2, sizeof(uint32_t));
+    if (!x.sel || !x.pend)
+    {
+        free(x.sel);
+        graph_free(g);
+        failx("could not allocate random config");
+    }
+
+    long nw = sysconf(_SC_NPROCESSORS_ONLN);
+    nw = nw < 1 ? 1 : (nw > n ? n : nw);
+    diag_flush();
+    fflush(stdout);
+    fflush(stderr);
+
+    uint32_t nfail = 0;
+    for (long w = 0; w < nw; w++)
+    {
+        pid_t p = fork();
+        if (p < 0)
+        {
+            diagx(DIAG_ERROR, NULL, "could not start a worker process: %s",
+                                                            strerror(errno));
+            nw = w;
+            break;
+        }
+        if (p)
+            continue;
+
+        /* a failure ends the worker, not the call of its parent */
+        ck->cascade = random_cascade;
+        ck->cascade_arg = &x;
+        if (!setjmp(ck->fail))
+            for (uint32_t k = w; k < n; k += nw)
+                random_config(&x, s + k);
+        diag_flush();
+        fflush(stdout);
+        if (ck->nerrs != nerrs)
+            warnx("%s", ck->error);
+        _exit(ck->nerrs != nerrs ? 1 : 0);
+    }
+    for (long w = 0; w < nw; w++)
+    {
+        int st;
+        if (wait(&st) < 0 || !WIFEXITED(st) || WEXITSTATUS(st))
+            nfail++;
+    }
+    if (nfail)
+        diagx(DIAG_ERROR, NULL, "%u random config worker(s) failed", nfail);
+
+    free(x.sel);
+    free(x.pend);
+    graph_free(g);
+    return ck_unbind(nerrs != h->nerrs ? -1 : 0);
+}
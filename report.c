@@ -0,0 +1,516 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <inttypes.h>
+#include "configk.h"
+#include "report.h"
+
+/*
+ * Reports of configk without a module of their own: the listing of the
+ * tree, --search, --fingerprint and the trace of edits. They work on the
+ * engine of the handle they bind, as the other report modules do; the
+ * engine does not print any of them.
+ */
+
+#define curr_root (ck->curr_root)
+#define FDIFFSZ 8192    /* files of a fingerprint diff table */
+
+static char *
+tree_grep(const cNode *cur, const char *str)
+{
+    char *r = NULL;
+
+    if (cur->type == SENTRY)
+        return r;
+
+    cEntry *c = cur->data;
+    if (!strncmp(str, "s:", 2))
+    {
+        if (c->opt_select)
+            r = strstr(c->opt_select, str+2);
+    }
+    else if (c->opt_depends)
+        r = strstr(c->opt_depends, str);
+
+    return r;
+}
+
+/* 'last' is the file shown last, by this display */
+static void
+tree_display_sentry(cNode *cur, uint8_t sp, cNode **last)
+{
+    if (*last == cur)
+        return;
+
+    sEntry *s = cur->data;
+    if (ropts & R_CONFIG)
+    {
+        if (!(ropts & R_CHECK))
+            printf("\n# %s: %d\n#\n", s->fname, s->o_count);
+        else if (s->u_count)
+            printf("\n# %s\n#\n", s->fname);
+    }
+    else
+    {
+        for (int i = 0; i < sp; i++)
+            putchar(' ');
+        printf("%s: %d, %d\n", s->fname, s->s_count, s->o_count);
+    }
+    if (cur != curr_root)
+    {
+        ((sEntry *)curr_root->data)->o_count += s->o_count;
+        ((sEntry *)curr_root->data)->s_count += s->s_count;
+    }
+    *last = cur;
+
+    return;
+}
+
+static void
+tree_display_node(cNode *root, uint8_t sp, cNode **last)
+{
+    if (!root)
+        return;
+
+    cNode *cur = root;
+    if (rgrep && !tree_grep(cur, rgrep))
+        goto nxt;
+
+    if (cur->type == SENTRY)
+        tree_display_sentry(cur, sp, last);
+    if (cur->type == CHENTRY)
+    {
+        cEntry *c = cur->data;
+        for (int i = 0; i < sp; i++)
+            putchar(' ');
+        printf("%s:%s\n", c->opt_name, c->opt_prompt);
+    }
+    if (cur->type == CENTRY)
+    {
+        cEntry *c = cur->data;
+
+        if (rgrep)
+        {
+            uint8_t tsp = sp;
+            cNode *tcr = cur;
+            while (tcr->type != SENTRY)
+            {
+                tsp -= 2;
+                tcr = tcr->up;
+            }
+            tree_display_sentry(tcr, tsp, last);
+        }
+/*
+ *      if (ENABLE_CONFIG == c->opt_status)
+ *          validate_option(c->opt_name);
+ *      if (TOGGLE_CONFIG == c->opt_status)
+ *      {
+ *          warnx("option '%s' is disabled, skip toggle", c->opt_name);
+ *          c->opt_status = 0;
+ *      }
+ */
+        if (c->opt_status && c->opt_status != -CVALNOSET
+            && !check_depends(c->opt_name))
+            diagx(DIAG_DEPENDS, c->opt_name,
+                        "option dependency not met for '%s'", c->opt_name);
+
+        for (int i = 0; i < sp; i++)
+            putchar(' ');
+        if (c->opt_status > 0)
+            printf("\033[32m%s: %s\033[0m\n", c->opt_name, c->opt_value);
+        else if (c->opt_status < 0)
+            printf("\033[33m%s: %s\033[0m\n", c->opt_name, c->opt_value);
+        else
+            printf("%s\n", c->opt_name);
+    }
+
+nxt:
+    tree_display_node(cur->down, sp + 2, last);
+    tree_display_node(cur->next, sp, last);
+
+    return;
+}
+
+static void
+tree_display(cNode *root)
+{
+    cNode *last = NULL;
+
+    tree_display_node(root, 0, &last);
+    return;
+}
+
+static void
+tree_display_centry(cNode *cur, cNode **last)
+{
+    if (!cur)
+        return;
+    if (rgrep && !tree_grep(cur, rgrep))
+        goto nxt;
+
+    if (cur->type == CENTRY)
+    {
+        cEntry *c = cur->data;
+
+        if (rgrep)
+            tree_display_sentry(filenode(cur), 0, last);
+
+        if ((-CVALNOSET == c->opt_status)
+            || (!c->opt_status && !(ropts & R_CHECK)))
+            printf("# CONFIG_%s is not set\n", c->opt_name);
+        else if (c->opt_status)
+            /* check_depends(c->opt_name); */
+            printf("CONFIG_%s=%s\n", c->opt_name, c->opt_value);
+    }
+    else if (cur->type == CHENTRY)
+        tree_display_centry(cur->down, last);
+nxt:
+    tree_display_centry(cur->next, last);
+
+    return;
+}
+
+static void
+tree_display_file(cNode *root, cNode **last)
+{
+    if (!root)
+        return;
+
+    cNode *cur = root;
+    if (cur->type == SENTRY && !rgrep)
+        tree_display_sentry(cur, 0, last);
+
+    tree_display_centry(cur->down, last);
+    tree_display_file(cur->down, last);
+    tree_display_file(cur->next, last);
+
+    return;
+}
+
+static void
+tree_display_config(cNode *root)
+{
+    cNode *last = NULL;
+
+    tree_display_file(root, &last);
+    return;
+}
+
+static void
+tree_display_jnode(cNode *root, uint8_t sp)
+{
+    if (!root)
+        return;
+
+    cNode *cur = root;
+    if (rgrep && !tree_grep(cur, rgrep))
+        goto nxt;
+
+    if (cur->type == SENTRY)
+    {
+        sEntry *s = cur->data;
+        json_sentry(s->fname, sp, s->s_count, s->o_count);
+        if (cur != curr_root)
+        {
+            ((sEntry *)curr_root->data)->o_count += s->o_count;
+            ((sEntry *)curr_root->data)->s_count += s->s_count;
+        }
+    }
+    else
+    {
+        ck_option o;
+        ck_option_fill(&o, cur);
+        json_option(&o, cur->type == CENTRY ? check_depends(o.name) : -1,
+                                                                    false);
+    }
+
+nxt:
+    tree_display_jnode(cur->down, sp + 1);
+    tree_display_jnode(cur->next, sp);
+
+    return;
+}
+
+static void
+tree_display_json(cNode *root)
+{
+    tree_display_jnode(root, 0);
+    return;
+}
+
+
+/* list the tree, as text, a config file with --config, or JSON objects */
+int
+list_kconfigs(ck_handle *h)
+{
+    CK_ENTER(h, -1);
+    if (!h->root_node)
+    {
+        diagx(DIAG_ERROR, NULL, "no tree loaded to list");
+        return ck_unbind(-1);
+    }
+
+    uint32_t nerrs = h->nerrs;
+    FILE *out = stderr;
+    cNode *r = tree_root();
+
+    if (ropts & R_JSON)
+    {
+        tree_display_json(r);
+        json_summary(((sEntry *)r->data)->s_count,
+                                ((sEntry *)r->data)->o_count);
+        return ck_unbind(nerrs != h->nerrs ? -1 : 0);
+    }
+    else if (ropts & R_CONFIG && ropts & R_CHECK)
+    {
+        printf("# This file is generated by %s\n", rprog);
+        tree_display_config(r);
+    }
+    else if (ropts & R_CONFIG)
+        tree_display_config(r);
+    else
+    {
+        tree_display(r);
+        out = stdout;
+    }
+
+    fprintf(out, "Config files: %d\n", ((sEntry *)r->data)->s_count);
+    fprintf(out, "Config options: %d\n", ((sEntry *)r->data)->o_count);
+    return ck_unbind(nerrs != h->nerrs ? -1 : 0);
+}
+
+int
+search_kconfigs(ck_handle *h, const char *query)
+{
+    CK_ENTER(h, -1);
+    sHit *hits;
+    uint32_t n = search_configs(query, &hits);
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        cEntry *t = hits[i].c->data;
+        const char *f = ((sEntry *)filenode(hits[i].c)->data)->fname;
+
+        if (ropts & R_JSON)
+            json_search(f, t->opt_name, t->opt_prompt, hits[i].score);
+        else if (t->opt_prompt)
+            printf("%s: %s: %s\n", f, t->opt_name, t->opt_prompt);
+        else
+            printf("%s: %s\n", f, t->opt_name);
+    }
+    if (!(ropts & R_JSON))
+        printf("Options found: %u\n", n);
+
+    free(hits);
+    return ck_unbind(0);
+}
+
+
+typedef struct
+{
+    uint64_t sub;
+    uint64_t own;
+    char *fname;
+    bool seen;
+} fSaved; /* file entry of a saved fingerprint */
+
+static void
+fprint_report(const sEntry *s, uint64_t sub, uint64_t own, const char *diff)
+{
+    if (ropts & R_JSON)
+        json_fprint(s->fname, sub, own, diff);
+    else if (diff)
+        printf("%s: %s\n", diff, s->fname);
+    else
+        printf("%016" PRIx64 " %016" PRIx64 " %s\n", sub, own, s->fname);
+
+    return;
+}
+
+static void
+fprint_list(const cNode *c)
+{
+    for (; c; c = c->next)
+    {
+        if (c->type == SENTRY)
+        {
+            sEntry *s = c->data;
+            fprint_report(s, s->f_sub, s->f_own, NULL);
+        }
+        fprint_list(c->down);
+    }
+
+    return;
+}
+
+/* files of a subtree are the same as the saved ones, mark them seen */
+static void
+fprint_seen(const cNode *c, struct hsearch_data *h)
+{
+    ENTRY e, *r;
+
+    for (; c; c = c->next)
+    {
+        if (c->type == SENTRY)
+        {
+            e.key = ((sEntry *)c->data)->fname;
+            if (hsearch_r(e, FIND, &r, h) && r)
+                ((fSaved *)r->data)->seen = true;
+        }
+        fprint_seen(c->down, h);
+    }
+
+    return;
+}
+
+static uint32_t
+fprint_diff(const cNode *c, struct hsearch_data *h)
+{
+    ENTRY e, *r;
+    uint32_t n = 0;
+
+    for (; c; c = c->next)
+    {
+        if (c->type != SENTRY)
+        {
+            n += fprint_diff(c->down, h);
+            continue;
+        }
+
+        sEntry *s = c->data;
+        e.key = s->fname;
+        fSaved *f = (hsearch_r(e, FIND, &r, h) && r) ? r->data : NULL;
+        if (f)
+            f->seen = true;
+        if (f && f->sub == s->f_sub)
+        {
+            fprint_seen(c->down, h);
+            continue;
+        }
+        if (!f || f->own != s->f_own)
+        {
+            fprint_report(s, s->f_sub, s->f_own, f ? "changed" : "added");
+            n++;
+        }
+        n += fprint_diff(c->down, h);
+    }
+
+    return n;
+}
+
+/*
+ * Show the fingerprint, one line per Kconfig file with its subtree and own
+ * hash; the first line is of the top file, its subtree hash is the
+ * fingerprint of the whole tree. With a file of an earlier fingerprint,
+ * show files whose options differ instead.
+ */
+int
+fprint_kconfigs(ck_handle *h, const char *ffile)
+{
+    CK_ENTER(h, -1);
+    fprint_root();
+    if (!ffile)
+    {
+        fprint_list(ck->root_node);
+        return ck_unbind(0);
+    }
+
+    FILE *fp = fopen(ffile, "r");
+    if (!fp)
+    {
+        diagx(DIAG_ERROR, NULL,
+                "could not open file: %s: %s", ffile, strerror(errno));
+        return ck_unbind(-1);
+    }
+
+    uint32_t nsaved = 0, savedsz = 0;
+    fSaved *saved = NULL;
+    char *line = NULL;
+    size_t lsz = 0;
+    while (getline(&line, &lsz, fp) > 0)
+    {
+        uint64_t sub, own;
+        int n = 0;
+
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "%" SCNx64 " %" SCNx64 " %n", &sub, &own, &n) < 2
+            || !n || !line[n])
+            continue;
+        if (nsaved == savedsz)
+        {
+            savedsz = savedsz ? savedsz * 2 : 256;
+            saved = realloc(saved, savedsz * sizeof(fSaved));
+            if (!saved)
+                failx("could not allocate fingerprint");
+        }
+        saved[nsaved++] = (fSaved){ sub, own, strdup(line + n), false };
+    }
+    free(line);
+    fclose(fp);
+
+    struct hsearch_data t;
+    memset(&t, 0, sizeof(t));
+    if (!hcreate_r(nsaved * 2 + FDIFFSZ, &t))
+        failx("could not create fingerprint table");
+    for (uint32_t i = 0; i < nsaved; i++)
+    {
+        ENTRY e = { saved[i].fname, &saved[i] }, *r;
+        hsearch_r(e, ENTER, &r, &t);
+    }
+
+    uint32_t n = 0;
+    if (nsaved && saved[0].sub == ((sEntry *)ck->root_node->data)->f_sub)
+        fprint_seen(ck->root_node, &t);
+    else
+        n = fprint_diff(ck->root_node, &t);
+    for (uint32_t i = 0; i < nsaved; i++)
+    {
+        if (!saved[i].seen)
+        {
+            sEntry s = { .fname = saved[i].fname };
+            fprint_report(&s, saved[i].sub, saved[i].own, "removed");
+            n++;
+        }
+        free(saved[i].fname);
+    }
+    if (!(ropts & R_JSON))
+        printf("Files changed: %u\n", n);
+
+    hdestroy_r(&t);
+    free(saved);
+    return ck_unbind(0);
+}
+
+/* trace callback: options an edit changes, indented by their depth */
+void
+edit_trace(const ck_option *o, int edit, int depth, const char *head,
+                                                                void *arg)
+{
+    (void)arg;
+    if (ropts & R_JSON)
+    {
+        json_edit(edit, o, depth);
+        return;
+    }
+
+    if (head)
+        fprintf(stderr, "%*s%s\n", 2 * depth - 2, "", head);
+    fprintf(stderr, "%*s%s\n", 2 * depth, "", o->name);
+
+    return;
+}
@@ -0,0 +1,83 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "libconfigk.h"
+
+/*
+ * Reports of the configk program, they are not part of libconfigk. Each
+ * report works on the handle it is given and writes to stdout, as text or
+ * as JSON objects, one per line. It returns -1 with ck_error() set when it
+ * fails, or 0 or its count of problems.
+ */
+
+enum ROPTS
+{
+    R_VERBOSE = 0x1,
+    R_CONFIG = 0x2,     /* output as a config file */
+    R_CHECK = 0x4,      /* values are read from config files */
+    R_JSON = 0x8,
+    R_SUMMARY = 0x10    /* only the count of warnings of each kind */
+};
+
+extern uint8_t ropts;
+extern const char *rprog;
+extern const char *rgrep;   /* --grep attribute string */
+
+extern int list_kconfigs(ck_handle *);
+extern int search_kconfigs(ck_handle *, const char *);
+extern int fprint_kconfigs(ck_handle *, const char *);
+extern int impact_configs(ck_handle *, const char *);
+extern int tdiff_kconfigs(ck_handle *, const char *);
+extern int minimize_kconfigs(ck_handle *);
+extern int random_kconfigs(ck_handle *, const char *, const char *);
+extern int lint_kconfigs(ck_handle *);
+extern int depgraph_kconfigs(ck_handle *, const char *);
+extern int solve_configs(ck_handle *, const char *);
+extern int mtree_kconfigs(const char *, char *[], uint16_t, char *[],
+                                                                uint16_t);
+extern void edit_trace(const ck_option *, int, int, const char *, void *);
+
+extern void diag_start(void);
+extern void diag_report(const char *, const char *, const char *, void *);
+extern void diag_flush(void);
+extern void diag_free(void);
+
+extern void json_init(void);
+extern void json_sentry(const char *, uint8_t, uint32_t, uint32_t);
+extern void json_option(const ck_option *, int, bool);
+extern void json_edit(int, const ck_option *, int);
+extern void json_diag(const char *, const char *, const char *);
+extern void json_summary(uint32_t, uint32_t);
+extern void json_impact(const char *, const char *, const char *, uint16_t,
+                                                                const char *);
+extern void json_search(const char *, const char *, const char *, uint32_t);
+extern void json_fprint(const char *, uint64_t, uint64_t, const char *);
+extern void json_tdiff(const char *, const char *, const char *,
+                        const char *, const char *, const char *);
+extern void json_lint(const char *, const char *, const char *, const char *);
+extern void json_mtree(const char *, const char *, const char *,
+                                                const char *[], uint16_t);
+extern void json_graph(const char *, uint32_t, const char *[], uint32_t);
+extern void json_solve(const char *, const char *, const char *);
+extern void json_complete(const char *);
+
+#endif
@@ -0,0 +1,250 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <ctype.h>
+#include "configk.h"
+
+/*
+ * --search: trigram index over option names, prompts and help text. Each
+ * lower cased trigram is hashed into one of TRIGRAMSZ posting lists of
+ * option numbers, stored in CSR form. A query reads the shortest list of
+ * its trigrams and verifies those candidates against the text, hash
+ * collisions only cost a few extra checks.
+ */
+
+#define TRIGRAMSZ 0x10000
+
+struct s_index
+{
+    uint32_t ndoc;
+    cNode **doc;        /* option number => tree node */
+    uint32_t *off;      /* off[k] .. off[k+1]: options with trigram hash k */
+    uint32_t *post;
+};
+
+static uint32_t
+trigram(const char *s)
+{
+    uint32_t k = tolower((uint8_t)s[0]) << 16
+                | tolower((uint8_t)s[1]) << 8 | tolower((uint8_t)s[2]);
+
+    return (k * 2654435761u) >> 16;
+}
+
+static void
+search_docs(sIndex *x, cNode *c)
+{
+    for (; c; c = c->next)
+    {
+        if (c->type == CENTRY || c->type == CHENTRY)
+        {
+            if (x->ndoc % 1024 == 0)
+            {
+                x->doc = realloc(x->doc, (x->ndoc + 1024) * sizeof(cNode *));
+                if (!x->doc)
+                    failx("could not allocate search index");
+            }
+            x->doc[x->ndoc++] = c;
+        }
+        search_docs(x, c->down);
+    }
+
+    return;
+}
+
+/* count (fill) postings of a text; 'last' dedups trigrams of an option */
+static void
+search_text(sIndex *x, uint32_t d, const char *s, uint32_t *last, bool fill)
+{
+    if (!s)
+        return;
+
+    for (; s[0] && s[1] && s[2]; s++)
+    {
+        uint32_t k = trigram(s);
+        if (last[k] == d + 1)
+            continue;
+
+        last[k] = d + 1;
+        if (fill)
+            x->post[x->off[k + 1]++] = d;
+        else
+            x->off[k + 2]++;
+    }
+
+    return;
+}
+
+static sIndex *
+search_build(void)
+{
+    sIndex *x = calloc(1, sizeof(sIndex));
+    uint32_t *last = calloc(TRIGRAMSZ, sizeof(uint32_t));
+    if (!x || !last || !(x->off = calloc(TRIGRAMSZ + 2, sizeof(uint32_t))))
+        failx("could not allocate search index");
+
+    search_docs(x, ck->root_node);
+    for (uint8_t fill = 0; fill < 2; fill++)
+    {
+        if (fill)
+        {
+            for (uint32_t k = 2; k < TRIGRAMSZ + 2; k++)
+                x->off[k] += x->off[k - 1];
+            x->post = calloc(x->off[TRIGRAMSZ + 1] + 1, sizeof(uint32_t));
+            if (!x->post)
+                failx("could not allocate search index");
+            memset(last, 0, TRIGRAMSZ * sizeof(uint32_t));
+        }
+        for (uint32_t d = 0; d < x->ndoc; d++)
+        {
+            cEntry *t = x->doc[d]->data;
+            search_text(x, d, t->opt_name, last, fill);
+            search_text(x, d, t->opt_prompt, last, fill);
+            search_text(x, d, t->opt_help, last, fill);
+        }
+    }
+
+    free(last);
+    return x;
+}
+
+/* number of case-insensitive occurrences of 'word' in 'text' */
+static uint32_t
+search_count(const char *text, const char *word)
+{
+    uint32_t n = 0;
+
+    if (!text)
+        return n;
+    for (; *text; text++)
+    {
+        const char *s = text, *w = word;
+        while (*w && tolower((uint8_t)*s) == *w)
+            s++, w++;
+        n += !*w;
+    }
+
+    return n;
+}
+
+/* name hits rank above prompt hits, prompt hits above help text hits */
+static uint32_t
+search_score(const cEntry *t, char **word, uint8_t nword)
+{
+    uint32_t score = 0;
+
+    for (uint8_t i = 0; i < nword; i++)
+    {
+        uint32_t h = search_count(t->opt_help, word[i]);
+        uint32_t s = 16 * !!search_count(t->opt_name, word[i])
+                    + 4 * !!search_count(t->opt_prompt, word[i])
+                    + (h > 4 ? 4 : h);
+        if (!s)
+            return 0;
+        score += s;
+    }
+
+    return score;
+}
+
+static int
+search_cmp(const void *a, const void *b)
+{
+    const sHit *x = a, *y = b;
+
+    if (x->score != y->score)
+        return x->score < y->score ? 1 : -1;
+
+    return x->id < y->id ? -1 : 1;
+}
+
+/*
+ * Find options matching all words of a query, best first. Returns the
+ * number of hits stored in '*hits', which the caller should free.
+ */
+uint32_t
+search_configs(const char *query, sHit **hits)
+{
+    uint8_t nword = 0;
+    char *word[32], *q = strdup(query);
+
+    if (!ck->sindex)
+        ck->sindex = search_build();
+    sIndex *x = ck->sindex;
+
+    for (char *p = q; *p; p++)
+        *p = tolower((uint8_t)*p);
+    for (char *w = strtok(q, " \t"); w && nword < 32; w = strtok(NULL, " \t"))
+        word[nword++] = w;
+
+    /* candidates: options with the rarest trigram of the query */
+    uint32_t b = 0, e = x->ndoc;
+    bool all = true;
+    for (uint8_t i = 0; i < nword; i++)
+    {
+        for (const char *s = word[i]; s[0] && s[1] && s[2]; s++)
+        {
+            uint32_t k = trigram(s);
+            if (all || x->off[k + 1] - x->off[k] < e - b)
+            {
+                b = x->off[k];
+                e = x->off[k + 1];
+                all = false;
+            }
+        }
+    }
+
+    uint32_t n = 0;
+    *hits = NULL;
+    for (uint32_t i = b; nword && i < e; i++)
+    {
+        uint32_t d = all ? i : x->post[i];
+        cNode *c = x->doc[d];
+        uint32_t score = search_score(c->data, word, nword);
+        if (!score)
+            continue;
+
+        if (n % 256 == 0 && !(*hits = realloc(*hits, (n + 256) * sizeof(sHit))))
+            failx("could not allocate search results");
+        (*hits)[n++] = (sHit){ c, d, score };
+    }
+    if (n)
+        qsort(*hits, n, sizeof(sHit), search_cmp);
+
+    free(q);
+    return n;
+}
+
+uint32_t
+search_free(void)
+{
+    uint32_t tmem = 0;
+    sIndex *x = ck->sindex;
+
+    if (!x)
+        return tmem;
+
+    tmem = x->ndoc * sizeof(cNode *) + (TRIGRAMSZ + 2) * sizeof(uint32_t)
+            + x->off[TRIGRAMSZ + 1] * sizeof(uint32_t);
+    free(x->doc);
+    free(x->off);
+    free(x->post);
+    free(x);
+    ck->sindex = NULL;
+
+    return tmem;
+}
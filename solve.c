@@ -0,0 +1,360 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <ctype.h>
+#include "configk.h"
+#include "report.h"
+
+/*
+ * --solve: the fewest option changes which meet the dependencies of an
+ * option, and of the options it selects. The search is an iterative
+ * deepening one over the symbol graph: an option whose dependencies are not
+ * met is given, one at a time, a changed value of a symbol its 'depends on'
+ * and block conditions refer to, and the conditions are evaluated again.
+ * An enabled symbol must have its own dependencies met in turn. Options
+ * without a prompt can not be set and are not tried, nor is disabling the
+ * member of a choice; enabling one disables the other members. Changes are
+ * made in journal transactions and rolled back, a failed option is kept in
+ * a table by the set of changes made before it, so that it is not searched
+ * again, and the search stops after a time budget.
+ */
+
+#define SOLVEMAX 8          /* most changes searched */
+#define SOLVEMS 2000        /* time budget, in milliseconds */
+#define SMEMOSZ 65536       /* failed searches kept, a power of 2 */
+
+typedef struct
+{
+    cEntry *t;
+    char *old;          /* value before the change */
+    const char *val;
+} vChange; /* change of a solution */
+
+typedef struct
+{
+    const sGraph *g;
+    vChange chg[SOLVEMAX + 1];
+    uint16_t nchg;
+    uint16_t limit;     /* changes allowed in this round */
+    uint64_t state;     /* hash of the changes made, in any order */
+    uint64_t *memo;     /* failed searches, by option, state and limit */
+    uint32_t mark;      /* options changed */
+    struct timespec end;
+    bool timeout;
+} sRun; /* state of a search */
+
+static bool
+solve_enabled(const cEntry *t)
+{
+    return t->opt_status > 0 && t->opt_value && 'n' != tolower(*t->opt_value);
+}
+
+static bool
+solve_expired(sRun *x)
+{
+    struct timespec now;
+
+    if (x->timeout)
+        return true;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    x->timeout = now.tv_sec > x->end.tv_sec
+        || (now.tv_sec == x->end.tv_sec && now.tv_nsec > x->end.tv_nsec);
+
+    return x->timeout;
+}
+
+static uint64_t
+solve_key(const sRun *x, uint32_t id)
+{
+    uint64_t k = fnv(FNVBASIS, &id, sizeof(id));
+
+    k = fnv(k, &x->state, sizeof(x->state));
+    k = fnv(k, &x->limit, sizeof(x->limit));
+    k = fnv(k, &x->nchg, sizeof(x->nchg));
+    return k ? k : 1;
+}
+
+/* look up 'key' in the table, add it if 'add' */
+static bool
+solve_memo(sRun *x, uint64_t key, bool add)
+{
+    for (uint32_t i = key & (SMEMOSZ - 1), n = 0; n < SMEMOSZ;
+                                    i = (i + 1) & (SMEMOSZ - 1), n++)
+    {
+        if (x->memo[i] == key)
+            return true;
+        if (!x->memo[i])
+        {
+            if (add)
+                x->memo[i] = key;
+            return false;
+        }
+    }
+
+    return false;
+}
+
+/* value to try for 'd', or NULL if it can not be changed */
+static const char *
+solve_value(const sRun *x, const cEntry *d)
+{
+    if (d->opt_mark == x->mark || !d->opt_prompt
+        || (CBOOL != d->opt_type && CTRISTATE != d->opt_type))
+        return NULL;
+    if (!solve_enabled(d))
+        return "y";
+
+    return d->opt_group ? NULL : "n";
+}
+
+static void
+solve_set(sRun *x, cEntry *t, const char *val)
+{
+    vChange *v = &x->chg[x->nchg++];
+
+    v->t = t;
+    v->old = strdup(solve_enabled(t) ? t->opt_value : "n");
+    v->val = val;
+    x->state ^= fnv(fnv(FNVBASIS, t->opt_name, strlen(t->opt_name)),
+                                                        val, strlen(val));
+    t->opt_mark = x->mark;
+
+    if ('n' == *val)
+    {
+        toggle_configs(t->opt_name, DISABLE_CONFIG, NULL, false);
+        return;
+    }
+
+    toggle_configs(t->opt_name, ENABLE_CONFIG, (char *)val, false);
+    chGroup *grp = t->opt_group;
+    for (uint16_t i = 0; grp && grp->choice->data != t && i < grp->nmember;
+                                                                        i++)
+    {
+        cEntry *m = grp->member[i]->data;
+        if (m != t && solve_enabled(m))
+            toggle_configs(m->opt_name, DISABLE_CONFIG, NULL, false);
+    }
+
+    return;
+}
+
+static void
+solve_unset(sRun *x)
+{
+    vChange *v = &x->chg[--x->nchg];
+
+    x->state ^= fnv(fnv(FNVBASIS, v->t->opt_name, strlen(v->t->opt_name)),
+                                                    v->val, strlen(v->val));
+    v->t->opt_mark = 0;
+    free(v->old);
+
+    return;
+}
+
+/* meet the dependencies of symbol 'id' with the changes left */
+static bool
+solve_goal(sRun *x, uint32_t id)
+{
+    const sGraph *g = x->g;
+    cEntry *t = g->sym[id]->data;
+
+    if (check_depends(t->opt_name) > 0)
+        return true;
+    if (x->nchg >= x->limit || solve_expired(x))
+        return false;
+
+    uint64_t key = solve_key(x, id);
+    if (solve_memo(x, key, false))
+        return false;
+
+    for (uint32_t e = g->out[id]; e < g->out[id + 1]; e++)
+    {
+        uint32_t w = g->oedge[e].to;
+        cEntry *d = g->sym[w]->data;
+        const char *val = solve_value(x, d);
+        if (EDEPENDS != g->oedge[e].type || !val)
+            continue;
+
+        /* changes of nested goals are merged in this transaction */
+        uint16_t n = x->nchg;
+        journal_begin();
+        solve_set(x, d, val);
+        if (('n' == *val || solve_goal(x, w)) && solve_goal(x, id))
+        {
+            journal_commit();
+            return true;
+        }
+        journal_rollback();
+        while (x->nchg > n)
+            solve_unset(x);
+        if (x->timeout)
+            return false;
+    }
+
+    solve_memo(x, key, true);
+    return false;
+}
+
+/* meet the dependencies of the options enabled by selects of 'id' */
+static bool
+solve_selects(sRun *x, uint32_t id)
+{
+    const sGraph *g = x->g;
+
+    for (uint32_t e = g->out[id]; e < g->out[id + 1]; e++)
+    {
+        uint32_t w = g->oedge[e].to;
+        cEntry *s = g->sym[w]->data;
+        if (ESELECT != g->oedge[e].type || !solve_enabled(s)
+            || s->opt_mark == x->mark)
+            continue;
+
+        s->opt_mark = x->mark;
+        if (!solve_goal(x, w) || !solve_selects(x, w))
+            return false;
+    }
+
+    return true;
+}
+
+static void
+solve_report(const sRun *x, const cEntry *t, const char *old,
+                                            const char *val, bool found)
+{
+    if (ropts & R_JSON)
+    {
+        for (uint16_t i = 0; found && i < x->nchg; i++)
+            json_solve(x->chg[i].t->opt_name, x->chg[i].old, x->chg[i].val);
+        json_solve(t->opt_name, old, found ? val : NULL);
+        return;
+    }
+
+    if (!found)
+    {
+        printf("No solution for %s=%s in %u changes%s\n", t->opt_name, val,
+                x->limit, x->timeout ? ", time budget exceeded" : "");
+        return;
+    }
+
+    printf("Changes: %u\n", x->nchg);
+    for (uint16_t i = 0; i < x->nchg; i++)
+        printf("  CONFIG_%s=%s (was %s)\n",
+                    x->chg[i].t->opt_name, x->chg[i].val, x->chg[i].old);
+    printf("  CONFIG_%s=%s (was %s)\n", t->opt_name, val, old);
+
+    return;
+}
+
+/* find the fewest changes to set 'sopt' (option=value), 0 if any, else 1 */
+int
+solve_configs(ck_handle *h, const char *sopt)
+{
+    CK_ENTER(h, -1);
+    uint32_t nerrs = h->nerrs;
+    char *opt = strdup(sopt);
+    if (!opt)
+        failx("could not allocate solve option");
+
+    char *val = strchr(opt, '=');
+    int r = 1;
+
+    val = val ? (*val++ = '\0', val) : "y";
+    cNode *c = hsearch_kconfigs(opt);
+    if (!c || c->type != CENTRY)
+    {
+        diagx(DIAG_MISSING, opt,
+                    "option '%s' not found in the source tree", opt);
+        free(opt);
+        return ck_unbind(r);
+    }
+    if ('n' == tolower(*val))
+    {
+        diagx(DIAG_ERROR, opt, "--solve needs a value to enable '%s'", opt);
+        free(opt);
+        return ck_unbind(-1);
+    }
+
+    /* changes are tried in silence, see diagx() and toggle_expand() */
+    uint32_t o = opts;
+    ck_diag_fn diag = ck->diag;
+    ck_trace_fn trace = ck->trace;
+    opts |= OUT_QUIET;
+    ck->diag = NULL;
+    ck->trace = NULL;
+
+    cEntry *t = c->data;
+    char *old = strdup(solve_enabled(t) ? t->opt_value : "n");
+    sRun x = { .g = graph_build(NULL, NULL),
+                .memo = calloc(SMEMOSZ, sizeof(uint64_t)) };
+    if (!x.memo)
+        failx("could not allocate solver table");
+    clock_gettime(CLOCK_MONOTONIC, &x.end);
+    x.end.tv_sec += SOLVEMS / 1000;
+    x.end.tv_nsec += (SOLVEMS % 1000) * 1000000L;
+    if (x.end.tv_nsec >= 1000000000L)
+    {
+        x.end.tv_sec++;
+        x.end.tv_nsec -= 1000000000L;
+    }
+
+    bool found = false;
+    for (x.limit = 0; x.limit <= SOLVEMAX && !found && !x.timeout;)
+    {
+        journal_begin();
+        x.nchg = 0;
+        x.state = 0;
+        x.mark = graph_mark();
+        t->opt_mark = x.mark;
+
+        if (solve_goal(&x, t->opt_id))
+        {
+            /* failures before the selects are not those after them */
+            toggle_configs(t->opt_name, ENABLE_CONFIG, val, true);
+            x.state ^= FNVBASIS;
+            found = solve_selects(&x, t->opt_id);
+        }
+        if (found)
+        {
+            opts = o;
+            ck->diag = diag;
+            ck->trace = trace;
+            solve_report(&x, t, old, val, true);
+        }
+        journal_rollback();
+        while (x.nchg)
+            solve_unset(&x);
+        if (!found && !x.timeout)
+            x.limit++;
+    }
+
+    opts = o;
+    ck->diag = diag;
+    ck->trace = trace;
+    if (!found)
+    {
+        x.limit -= x.limit > SOLVEMAX;
+        solve_report(&x, t, old, val, false);
+    }
+
+    r = found ? 0 : 1;
+    free(x.memo);
+    graph_free((sGraph *)x.g);
+    free(old);
+    free(opt);
+    return ck_unbind(nerrs != h->nerrs ? -1 : r);
+}
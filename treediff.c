@@ -0,0 +1,268 @@
+/*
+ * configk: an easy way to edit kernel configuration files and templates
+ * Copyright (C) 2023-2024 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See COPYING file or <http://www.gnu.org/licenses/> for more details.
+ */
+
+#include <stdio.h>
+#include "configk.h"
+#include "report.h"
+
+/*
+ * Tree diff: options of an old source tree are matched by name with the
+ * ones of the tree in use and their attributes are compared field by
+ * field. Changes are reported per Kconfig file of the tree in use, options
+ * removed from a file are reported with the file of the old tree.
+ */
+
+extern const char *types[];
+
+enum
+{
+    TADDED = 0x0,
+    TREMOVED = 0x1,
+    TCHANGED = 0x2,
+    TMOVED = 0x3
+};
+
+static const char *tchanges[] = { "added", "removed", "changed", "moved" };
+
+typedef struct
+{
+    const char *name;
+    char *value;
+} tField; /* compared attribute of an option */
+
+#define TFIELDSZ 8
+
+typedef struct
+{
+    ckHandle *old;
+    const sEntry *head; /* file of the last change shown */
+    uint32_t count[4];
+} tRun; /* state of a diff */
+
+/* attributes of an option, conditions of blocks are joined with '&&' */
+static void
+tdiff_fields(const cEntry *t, tField *f)
+{
+    char *blk = NULL;
+
+    for (const bCond *b = t->opt_block; b; b = b->up)
+    {
+        if (!b->expr)
+            continue;
+
+        char *n = calloc(strlen(b->expr) + (blk ? strlen(blk) + 5 : 1), 1);
+        if (!n)
+            failx("could not allocate block conditions");
+        sprintf(n, "%s%s%s", b->expr, blk ? " && " : "", blk ? blk : "");
+        free(blk);
+        blk = n;
+    }
+
+    f[0] = (tField){ "type", (char *)types[t->opt_type] };
+    f[1] = (tField){ "default", t->opt_value };
+    f[2] = (tField){ "prompt", t->opt_prompt };
+    f[3] = (tField){ "depends", t->opt_depends };
+    f[4] = (tField){ "block", blk };
+    f[5] = (tField){ "select", t->opt_select };
+    f[6] = (tField){ "imply", t->opt_imply };
+    f[7] = (tField){ "range", t->opt_range };
+
+    return;
+}
+
+static void
+tdiff_report(tRun *x, const sEntry *s, const cEntry *t, uint8_t change,
+                        const char *field, const char *from, const char *to)
+{
+    if (ropts & R_JSON)
+    {
+        json_tdiff(s->fname, t->opt_name, tchanges[change], field, from, to);
+        return;
+    }
+
+    if (x->head != s)
+        printf("\n# %s\n", s->fname);
+    x->head = s;
+    if (TADDED == change)
+        printf("+ %s\n", t->opt_name);
+    else if (TREMOVED == change)
+        printf("- %s\n", t->opt_name);
+    else if (TMOVED == change)
+        printf("> %s: moved from %s\n", t->opt_name, from);
+    else
+        printf("~ %s: %s: %s => %s\n", t->opt_name, field,
+                                from ? from : "(none)", to ? to : "(none)");
+
+    return;
+}
+
+static cNode *
+tdiff_lookup(ckHandle *h, const char *key)
+{
+    ENTRY e, *r;
+
+    e.key = (char *)key;
+    if (!strcmp(key, ((sEntry *)h->root_node->data)->fname))
+        return h->root_node;
+    if (!hsearch_r(e, FIND, &r, &h->c_chash) || !r)
+        return NULL;
+
+    return r->data;
+}
+
+/* compare an option of the tree in use with the old one */
+static void
+tdiff_option(tRun *x, const cNode *c, const sEntry *s)
+{
+    tField fn[TFIELDSZ], fo[TFIELDSZ];
+    cEntry *t = c->data;
+    cNode *o = tdiff_lookup(x->old, t->opt_name);
+
+    if (!o || o->type != CENTRY)
+    {
+        tdiff_report(x, s, t, TADDED, NULL, NULL, NULL);
+        x->count[TADDED]++;
+        return;
+    }
+
+    const sEntry *os = filenode(o)->data;
+    if (strcmp(os->fname, s->fname))
+    {
+        tdiff_report(x, s, t, TMOVED, NULL, os->fname, s->fname);
+        x->count[TMOVED]++;
+    }
+
+    tdiff_fields(t, fn);
+    tdiff_fields(o->data, fo);
+    bool changed = false;
+    for (uint8_t i = 0; i < TFIELDSZ; i++)
+    {
+        if (fn[i].value == fo[i].value || (fn[i].value && fo[i].value
+            && !strcmp(fn[i].value, fo[i].value)))
+            continue;
+        tdiff_report(x, s, t, TCHANGED, fn[i].name, fo[i].value,
+                                                                fn[i].value);
+        changed = true;
+    }
+    x->count[TCHANGED] += changed;
+
+    free(fn[4].value);
+    free(fo[4].value);
+    return;
+}
+
+/*
+ * Walk options of one file, not of the files it sources. The old tree is
+ * walked for options which are not in the tree in use.
+ */
+static void
+tdiff_file(tRun *x, const cNode *c, const sEntry *s, bool removed)
+{
+    for (; c; c = c->next)
+    {
+        if (c->type == SENTRY)
+            continue;
+        if (c->type == CENTRY)
+        {
+            cEntry *t = c->data;
+            cNode *n = tdiff_lookup(removed ? x->old : ck, t->opt_name);
+
+            /* options defined more than once are compared once */
+            if (n == c && !removed)
+                tdiff_option(x, c, s);
+            else if (n == c && !tdiff_lookup(ck, t->opt_name))
+            {
+                tdiff_report(x, s, t, TREMOVED, NULL, NULL, NULL);
+                x->count[TREMOVED]++;
+            }
+        }
+        tdiff_file(x, c->down, s, removed);
+    }
+
+    return;
+}
+
+static void
+tdiff_walk(tRun *x, const cNode *c, bool removed)
+{
+    for (; c; c = c->next)
+    {
+        if (c->type != SENTRY)
+        {
+            tdiff_walk(x, c->down, removed);
+            continue;
+        }
+
+        sEntry *s = c->data;
+        if (!removed)
+        {
+            cNode *o = tdiff_lookup(x->old, s->fname);
+            tdiff_file(x, c->down, s, false);
+            if (o && o->type == SENTRY)
+                tdiff_file(x, o->down, s, true);
+        }
+        else if (!tdiff_lookup(ck, s->fname))
+            tdiff_file(x, c->down, s, true);
+
+        tdiff_walk(x, c->down, removed);
+    }
+
+    return;
+}
+
+/* 'e' tells why the old tree could not be loaded */
+static int
+tdiff_run(ck_handle *h, tRun *x, const char *e)
+{
+    CK_ENTER(h, -1);
+    if (e)
+    {
+        diagx(DIAG_ERROR, NULL, "%s", e);
+        return ck_unbind(-1);
+    }
+
+    tdiff_walk(x, ck->root_node, false);
+
+    /* old files which are not in the tree in use */
+    tdiff_walk(x, x->old->root_node, true);
+
+    if (!(ropts & R_JSON))
+        printf("\nOptions added: %u, removed: %u, changed: %u, moved: %u\n",
+                x->count[TADDED], x->count[TREMOVED], x->count[TCHANGED],
+                x->count[TMOVED]);
+
+    return ck_unbind(0);
+}
+
+/* diff the Kconfig tree of 'srcdir' against the one in use */
+int
+tdiff_kconfigs(ck_handle *h, const char *srcdir)
+{
+    /* loaded before 'h' is bound: calls of the library do not nest */
+    tRun x = { ck_open(h->c_gstr[IARCH]), NULL, { 0 } };
+    const char *e = "could not create configk handle";
+
+    if (x.old)
+    {
+        ck_set_flags(x.old, ropts & R_VERBOSE ? CK_VERBOSE : 0);
+        e = ck_load_tree(x.old, srcdir) ? ck_error(x.old) : NULL;
+    }
+
+    int r = tdiff_run(h, &x, e);
+    ck_free(x.old);
+
+    return r;
+}